@@ -0,0 +1,194 @@
+#define _DEFAULT_SOURCE
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "decoder_threads.h"
+#include "frame_allocator.h"
+
+// 解码吞吐量测试: 只 demux + 解码视频流, 不转换不显示, 比较不同的解码线程配置.
+// 每个配置在单独的子进程里跑, 用 wait4 拿到子进程的 CPU 时间(所有线程之和), 峰值内存(ru_maxrss)
+// 和缺页次数, 互不影响; fps 按墙钟时间算, cpu/wall 大约是实际用满了几个核.
+// 用法: bench_decode <file> [--frames N] [--frame-buffers default|pool|huge] [TYPE[:THREADS] ...]
+//   TYPE 为 auto/frame/slice/both, THREADS 省略或为0时按核数自动选择;
+//   不给配置时比较 both:1(单线程) slice frame both
+
+typedef struct Result {
+    int64_t nb_frames;
+    int64_t wall_us;
+    int thread_count;
+    int active_thread_type;
+} Result;
+
+static int decode_file(const char* path, const DecoderThreads* threads, int frame_buffers, int64_t max_frames,
+                       Result* result) {
+    AVFormatContext* fmt_ctx = NULL;
+    if (avformat_open_input(&fmt_ctx, path, NULL, NULL) < 0 || avformat_find_stream_info(fmt_ctx, NULL) < 0) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return -1;
+    }
+    int stream = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (stream < 0) {
+        fprintf(stderr, "No video stream in %s\n", path);
+        return -1;
+    }
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        if ((int)i != stream) {
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    const AVCodec* codec = avcodec_find_decoder(fmt_ctx->streams[stream]->codecpar->codec_id);
+    AVCodecContext* codec_ctx = avcodec_alloc_context3(codec);
+    if (!codec || !codec_ctx || avcodec_parameters_to_context(codec_ctx, fmt_ctx->streams[stream]->codecpar) < 0) {
+        fprintf(stderr, "Could not create decoder\n");
+        return -1;
+    }
+    FrameAllocator frame_allocator;
+    if (frame_allocator_init(&frame_allocator, frame_buffers) < 0) {
+        return -1;
+    }
+    frame_allocator_attach(&frame_allocator, codec_ctx);
+    decoder_threads_apply(threads, codec_ctx);
+    if (avcodec_open2(codec_ctx, codec, NULL) < 0) {
+        fprintf(stderr, "avcodec_open2 failed\n");
+        return -1;
+    }
+    result->thread_count = codec_ctx->thread_count;
+    result->active_thread_type = codec_ctx->active_thread_type;
+    AVPacket* packet = av_packet_alloc();
+    AVFrame* frame = av_frame_alloc();
+    int64_t start = av_gettime_relative();
+    int eof = 0;
+    while (!eof && result->nb_frames < max_frames) {
+        int ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 送空包把解码器里缓存的帧都取出来
+            eof = 1;
+            ret = avcodec_send_packet(codec_ctx, NULL);
+        } else if (packet->stream_index == stream) {
+            ret = avcodec_send_packet(codec_ctx, packet);
+            av_packet_unref(packet);
+        } else {
+            av_packet_unref(packet);
+            continue;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "avcodec_send_packet failed\n");
+            break;
+        }
+        while (avcodec_receive_frame(codec_ctx, frame) >= 0) {
+            result->nb_frames++;
+            av_frame_unref(frame);
+        }
+    }
+    result->wall_us = av_gettime_relative() - start;
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codec_ctx);
+    frame_allocator_destroy(&frame_allocator);
+    avformat_close_input(&fmt_ctx);
+    return 0;
+}
+
+static int parse_config(DecoderThreads* t, const char* spec) {
+    char type[16];
+    decoder_threads_init(t);
+    if (sscanf(spec, "%15[a-z]:%d", type, &t->count) < 1) {
+        return -1;
+    }
+    return decoder_threads_parse_type(t, type);
+}
+
+static void run_config(const char* path, const char* spec, int frame_buffers, int64_t max_frames) {
+    DecoderThreads threads;
+    if (parse_config(&threads, spec) < 0) {
+        fprintf(stderr, "Invalid config %s\n", spec);
+        exit(1);
+    }
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        Result result;
+        memset(&result, 0, sizeof(result));
+        int ret = decode_file(path, &threads, frame_buffers, max_frames, &result);
+        if (write(fds[1], &result, sizeof(result)) != sizeof(result)) {
+            ret = -1;
+        }
+        _exit(ret < 0 ? 1 : 0);
+    }
+    close(fds[1]);
+    Result result;
+    ssize_t size = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 ||
+        size != sizeof(result) || result.wall_us <= 0) {
+        printf("  %-10s failed\n", spec);
+        return;
+    }
+    int64_t cpu_us = usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec +
+                     usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec;
+    printf("  %-10s %2d threads %-5s %7lld frames %8.1f fps  wall %8.1f ms  cpu %8.1f ms (%.2fx)  peak rss %7.1f MB"
+           "  faults %8ld\n",
+        spec, result.thread_count, decoder_threads_type_name(result.active_thread_type),
+        (long long)result.nb_frames, result.nb_frames * 1e6 / result.wall_us, result.wall_us / 1000.0,
+        cpu_us / 1000.0, (double)cpu_us / result.wall_us, usage.ru_maxrss / 1024.0,
+        usage.ru_minflt + usage.ru_majflt);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("Usage: bench_decode <file> [--frames N] [--frame-buffers default|pool|huge]"
+               " [auto|frame|slice|both[:THREADS] ...]\n");
+        return 1;
+    }
+    static const char* default_configs[] = { "both:1", "slice", "frame", "both" };
+    const char* configs[64];
+    int nb_configs = 0;
+    int64_t max_frames = INT64_MAX;
+    int frame_buffers = FRAME_BUFFERS_POOL;
+    for (int arg = 2; arg < argc; arg++) {
+        if (arg + 1 < argc && strcmp(argv[arg], "--frames") == 0) {
+            sscanf(argv[++arg], "%" SCNd64, &max_frames);
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--frame-buffers") == 0) {
+            frame_buffers = frame_allocator_parse_mode(argv[++arg]);
+            if (frame_buffers < 0) {
+                fprintf(stderr, "Invalid frame buffers %s\n", argv[arg]);
+                return 1;
+            }
+        } else if (nb_configs < 64) {
+            configs[nb_configs++] = argv[arg];
+        }
+    }
+    if (nb_configs == 0) {
+        for (size_t i = 0; i < sizeof(default_configs) / sizeof(default_configs[0]); i++) {
+            configs[nb_configs++] = default_configs[i];
+        }
+    }
+    static const char* frame_buffers_names[] = { "default", "pool", "huge" };
+    printf("decode %s, %d cores, %s frame buffers\n", argv[1], av_cpu_count(), frame_buffers_names[frame_buffers]);
+    for (int i = 0; i < nb_configs; i++) {
+        run_config(argv[1], configs[i], frame_buffers, max_frames);
+    }
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_encoder.h"
+
+// 单帧图片编码的速度和压缩率: PPM / QOI / PNG 各编码 frames 次, 报告每帧耗时, 每帧字节数和相对 rgb24 的比例.
+// 默认用合成的 1080p 图像(平滑渐变 + 少量噪声, 接近视频帧); 给出 PPM 文件时用它的内容,
+// 例如 tutorial01 --output ppm 导出的 tmp/frameN.ppm.
+// 用法: bench_image_encoder [frames] [input.ppm]
+
+typedef struct Image {
+    int width, height;
+    uint8_t* rgb;
+    int stride;
+} Image;
+
+static void make_image(Image* img, int width, int height) {
+    img->width = width;
+    img->height = height;
+    img->stride = width * 3;
+    img->rgb = malloc((size_t)img->stride * height);
+    if (!img->rgb) {
+        fprintf(stderr, "Could not allocate image\n");
+        exit(1);
+    }
+    uint32_t seed = 1;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            seed = seed * 1664525 + 1013904223;
+            uint8_t* p = img->rgb + (size_t)y * img->stride + x * 3;
+            int noise = (seed >> 16) % 5;
+            p[0] = (x * 255 / width + noise) & 255;
+            p[1] = (y * 255 / height + noise) & 255;
+            p[2] = ((x + y) / 8 + noise) & 255;
+        }
+    }
+}
+
+static int load_ppm(Image* img, const char* path) {
+    FILE* f = fopen(path, "rb");
+    int maxval;
+    if (!f || fscanf(f, "P6 %d %d %d", &img->width, &img->height, &maxval) != 3 || maxval != 255) {
+        fprintf(stderr, "Could not read %s (only binary 8-bit PPM)\n", path);
+        return -1;
+    }
+    fgetc(f);
+    img->stride = img->width * 3;
+    img->rgb = malloc((size_t)img->stride * img->height);
+    if (!img->rgb || fread(img->rgb, img->stride, img->height, f) != (size_t)img->height) {
+        fprintf(stderr, "Could not read %s\n", path);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int nb_frames = 50;
+    Image img;
+    if (argc > 1) {
+        sscanf(argv[1], "%d", &nb_frames);
+    }
+    if (argc > 2) {
+        if (load_ppm(&img, argv[2]) < 0) {
+            return 1;
+        }
+    } else {
+        make_image(&img, 1920, 1080);
+    }
+    printf("encode %dx%d rgb24, %d frames%s%s\n", img.width, img.height, nb_frames,
+        argc > 2 ? " from " : " (synthetic)", argc > 2 ? argv[2] : "");
+    double rgb_size = (double)img.width * img.height * 3;
+    static const ImageFormat formats[] = { IMAGE_PPM, IMAGE_QOI, IMAGE_PNG };
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        size_t bound = image_encode_bound(formats[f], img.width, img.height);
+        uint8_t* out = malloc(bound);
+        if (!out) {
+            fprintf(stderr, "Could not allocate output\n");
+            return 1;
+        }
+        int64_t size = 0;
+        int64_t start = av_gettime_relative();
+        for (int i = 0; i < nb_frames; i++) {
+            size = image_encode(formats[f], img.rgb, img.stride, img.width, img.height, out, bound);
+            if (size < 0) {
+                fprintf(stderr, "image_encode failed\n");
+                return 1;
+            }
+        }
+        int64_t us = av_gettime_relative() - start;
+        printf("  %-4s %8.2f ms/frame %8.1f MP/s %9.1f KB/frame %6.1f%%\n", image_format_extension(formats[f]),
+            us / 1000.0 / nb_frames, (double)img.width * img.height * nb_frames / us,
+            size / 1024.0, size * 100.0 / rgb_size);
+        free(out);
+    }
+    free(img.rgb);
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "packet_queue.h"
+
+// PacketQueue benchmark: 原来的 AVPacketList 链表队列 vs SPSC 环形队列.
+// 一个生产者线程, 一个消费者线程. 生产者把发送时间写进 pkt->pts, 消费者据此统计延迟.
+//   throughput: 生产者全速发送, 统计 packets/s
+//   latency:    生产者每隔 interval_us 发送一个包, 统计交接延迟的分位数
+
+#define BENCH_PACKET_SIZE 512
+
+// ---- 旧实现: 每个包 av_malloc 一个链表节点, 每次 put/get 都加锁 ----
+typedef struct ListPacketQueue {
+    AVPacketList* first_pkt;
+    AVPacketList* last_pkt;
+    int nb_packets;
+    int size;
+    int abort_request;
+    SDL_mutex* mutex;
+    SDL_cond* cond;
+} ListPacketQueue;
+
+static void list_queue_init(ListPacketQueue* q) {
+    memset(q, 0, sizeof(ListPacketQueue));
+    q->mutex = SDL_CreateMutex();
+    q->cond = SDL_CreateCond();
+}
+
+static void list_queue_destroy(ListPacketQueue* q) {
+    SDL_DestroyCond(q->cond);
+    SDL_DestroyMutex(q->mutex);
+}
+
+static int list_queue_put(ListPacketQueue* q, AVPacket* packet) {
+    AVPacketList* avPacketList = av_malloc(sizeof(AVPacketList));
+    if (!avPacketList) {
+        return -1;
+    }
+    avPacketList->pkt = *packet;
+    avPacketList->next = NULL;
+    SDL_LockMutex(q->mutex);
+    if (!q->last_pkt) {
+        q->first_pkt = avPacketList;
+    } else {
+        q->last_pkt->next = avPacketList;
+    }
+    q->last_pkt = avPacketList;
+    q->nb_packets++;
+    q->size += avPacketList->pkt.size;
+    SDL_CondSignal(q->cond);
+    SDL_UnlockMutex(q->mutex);
+    return 0;
+}
+
+static int list_queue_get(ListPacketQueue* q, AVPacket* pkt, int block) {
+    int ret;
+    SDL_LockMutex(q->mutex);
+    for (;;) {
+        if (q->abort_request) {
+            ret = -1;
+            break;
+        }
+        AVPacketList* avPacketList = q->first_pkt;
+        if (avPacketList) {
+            q->first_pkt = avPacketList->next;
+            if (!q->first_pkt) {
+                q->last_pkt = NULL;
+            }
+            q->nb_packets--;
+            q->size -= avPacketList->pkt.size;
+            *pkt = avPacketList->pkt;
+            av_free(avPacketList);
+            ret = 1;
+            break;
+        } else if (!block) {
+            ret = 0;
+            break;
+        } else {
+            SDL_CondWait(q->cond, q->mutex);
+        }
+    }
+    SDL_UnlockMutex(q->mutex);
+    return ret;
+}
+
+// ---- benchmark ----
+typedef struct BenchContext {
+    int use_ring;
+    ListPacketQueue list;
+    PacketQueue ring;
+    int nb_packets;
+    int interval_us;
+    int64_t* latencies;
+} BenchContext;
+
+static uint8_t payload[BENCH_PACKET_SIZE];
+
+static int producer_thread(void* arg) {
+    BenchContext* ctx = arg;
+    AVPacket* pkt = av_packet_alloc();
+    if (!pkt) {
+        return -1;
+    }
+    int64_t next = av_gettime_relative();
+    for (int i = 0; i < ctx->nb_packets; i++) {
+        if (ctx->interval_us > 0) {
+            next += ctx->interval_us;
+            while (av_gettime_relative() < next) {
+            }
+        }
+        // 不带引用计数的包, 两种队列都只做结构体搬运, 不引入额外的malloc
+        pkt->data = payload;
+        pkt->size = BENCH_PACKET_SIZE;
+        pkt->pts = av_gettime_relative();
+        int ret = ctx->use_ring ? packet_queue_put(&ctx->ring, pkt) : list_queue_put(&ctx->list, pkt);
+        if (ret < 0) {
+            av_packet_free(&pkt);
+            return -1;
+        }
+    }
+    av_packet_free(&pkt);
+    return 0;
+}
+
+static int cmp_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char* name, int use_ring, int nb_packets, int interval_us) {
+    BenchContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.use_ring = use_ring;
+    ctx.nb_packets = nb_packets;
+    ctx.interval_us = interval_us;
+    ctx.latencies = av_malloc_array(nb_packets, sizeof(int64_t));
+    if (!ctx.latencies) {
+        fprintf(stderr, "Could not allocate latency buffer\n");
+        exit(1);
+    }
+    if (use_ring) {
+        if (packet_queue_init(&ctx.ring, PACKET_QUEUE_DEFAULT_CAPACITY) < 0) {
+            exit(1);
+        }
+    } else {
+        list_queue_init(&ctx.list);
+    }
+
+    AVPacket* pkt = av_packet_alloc();
+    if (!pkt) {
+        fprintf(stderr, "Could not allocate packet\n");
+        exit(1);
+    }
+    int64_t start = av_gettime_relative();
+    SDL_Thread* producer = SDL_CreateThread(producer_thread, "producer", &ctx);
+    for (int i = 0; i < nb_packets; i++) {
+        int ret = use_ring ? packet_queue_get(&ctx.ring, pkt, 1) : list_queue_get(&ctx.list, pkt, 1);
+        if (ret <= 0) {
+            fprintf(stderr, "%s: get failed\n", name);
+            exit(1);
+        }
+        ctx.latencies[i] = av_gettime_relative() - pkt->pts;
+        av_packet_unref(pkt);
+    }
+    int64_t elapsed = av_gettime_relative() - start;
+    SDL_WaitThread(producer, NULL);
+    av_packet_free(&pkt);
+
+    qsort(ctx.latencies, nb_packets, sizeof(int64_t), cmp_int64);
+    printf("  %-12s %12.0f packets/s  latency us: p50 %6"PRId64" p99 %6"PRId64" p99.9 %6"PRId64" max %8"PRId64"\n",
+        name, nb_packets * 1e6 / elapsed,
+        ctx.latencies[nb_packets / 2],
+        ctx.latencies[(int)(nb_packets * 0.99)],
+        ctx.latencies[(int)(nb_packets * 0.999)],
+        ctx.latencies[nb_packets - 1]);
+
+    if (use_ring) {
+        packet_queue_destroy(&ctx.ring);
+    } else {
+        list_queue_destroy(&ctx.list);
+    }
+    av_free(ctx.latencies);
+}
+
+int main(int argc, char* argv[]) {
+    int nb_packets = 1000000;
+    int interval_us = 20;
+    if (argc > 1) {
+        sscanf(argv[1], "%d", &nb_packets);
+    }
+    if (argc > 2) {
+        sscanf(argv[2], "%d", &interval_us);
+    }
+    if (nb_packets <= 0) {
+        printf("Usage: ./bench_queue [packets] [latency-interval-us]\n");
+        return -1;
+    }
+    printf("throughput, %d packets\n", nb_packets);
+    run("list", 0, nb_packets, 0);
+    run("spsc-ring", 1, nb_packets, 0);
+
+    int nb_paced = nb_packets / 10 > 0 ? nb_packets / 10 : nb_packets;
+    printf("latency, %d packets every %d us\n", nb_paced, interval_us);
+    run("list", 0, nb_paced, interval_us);
+    run("spsc-ring", 1, nb_paced, interval_us);
+    return 0;
+}
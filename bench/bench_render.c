@@ -0,0 +1,134 @@
+#include <SDL2/SDL.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixdesc.h>
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "video_texture.h"
+
+// 纹理上传阶段的 micro-benchmark:
+// 对比 VideoTexture 的 UPDATE 模式(写中间缓冲区再 SDL_Update*Texture)与 LOCK 模式(直接写进锁定的纹理内存).
+// 只计上传耗时, 不 present. 无显示环境下可以用 SDL_VIDEODRIVER=dummy 和 software 渲染器运行.
+// 用法: bench_render [frames] [width] [height] [render-driver]
+
+static AVFrame* make_frame(enum AVPixelFormat pix_fmt, int width, int height) {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return NULL;
+    }
+    frame->format = pix_fmt;
+    frame->width = width;
+    frame->height = height;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    // 渐变图案, 各平面按行填充
+    for (int p = 0; p < 4 && frame->data[p]; p++) {
+        int rows = p == 0 ? height : (pix_fmt == AV_PIX_FMT_YUYV422 ? height : (height + 1) / 2);
+        for (int y = 0; y < rows; y++) {
+            for (int x = 0; x < frame->linesize[p]; x++) {
+                frame->data[p][y * frame->linesize[p] + x] = (uint8_t)(x + y * (p + 1));
+            }
+        }
+    }
+    return frame;
+}
+
+static int64_t run_mode(SDL_Renderer* renderer, AVFrame* frame, int nb_frames,
+                        int target_width, int target_height, enum VideoTextureMode mode,
+                        VideoTexture* vt) {
+    video_texture_init(vt, renderer);
+    video_texture_set_mode(vt, mode);
+    video_texture_set_size(vt, target_width, target_height);
+    // 先上传一帧完成纹理和SwsContext的创建, 不计入耗时
+    if (video_texture_upload(vt, frame) < 0) {
+        fprintf(stderr, "video_texture_upload failed\n");
+        exit(1);
+    }
+    int64_t start = av_gettime_relative();
+    for (int i = 0; i < nb_frames; i++) {
+        if (video_texture_upload(vt, frame) < 0) {
+            fprintf(stderr, "video_texture_upload failed\n");
+            exit(1);
+        }
+    }
+    return av_gettime_relative() - start;
+}
+
+static void run(SDL_Renderer* renderer, int nb_frames, enum AVPixelFormat pix_fmt,
+                int width, int height, int target_width, int target_height) {
+    AVFrame* frame = make_frame(pix_fmt, width, height);
+    if (!frame) {
+        fprintf(stderr, "Could not allocate frame\n");
+        exit(1);
+    }
+    VideoTexture vt;
+    int64_t update_us = run_mode(renderer, frame, nb_frames, target_width, target_height, VIDEO_TEXTURE_UPDATE, &vt);
+    int direct = vt.direct;
+    int out_width = vt.out_width;
+    int out_height = vt.out_height;
+    video_texture_free(&vt);
+    int64_t lock_us = run_mode(renderer, frame, nb_frames, target_width, target_height, VIDEO_TEXTURE_LOCK, &vt);
+    video_texture_free(&vt);
+
+    printf("%s %dx%d -> %dx%d (%s), %d frames\n",
+        av_get_pix_fmt_name(pix_fmt), width, height, out_width, out_height,
+        direct ? "direct" : "swscale", nb_frames);
+    printf("  update: %8.1f ms %8.1f fps %6.2f ms/frame\n",
+        update_us / 1000.0, nb_frames * 1e6 / update_us, update_us / 1000.0 / nb_frames);
+    printf("  lock:   %8.1f ms %8.1f fps %6.2f ms/frame\n",
+        lock_us / 1000.0, nb_frames * 1e6 / lock_us, lock_us / 1000.0 / nb_frames);
+    printf("  speedup: %.2fx\n", (double)update_us / lock_us);
+    av_frame_free(&frame);
+}
+
+int main(int argc, char* argv[]) {
+    int nb_frames = 500;
+    int width = 1920;
+    int height = 1080;
+    if (argc > 1) {
+        sscanf(argv[1], "%d", &nb_frames);
+    }
+    if (argc > 2) {
+        sscanf(argv[2], "%d", &width);
+    }
+    if (argc > 3) {
+        sscanf(argv[3], "%d", &height);
+    }
+    if (argc > 4) {
+        SDL_SetHint(SDL_HINT_RENDER_DRIVER, argv[4]);
+    }
+    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+        fprintf(stderr, "SDL_Init failed - %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_Window* window = SDL_CreateWindow("bench_render", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+        width, height, SDL_WINDOW_HIDDEN);
+    if (!window) {
+        fprintf(stderr, "SDL_CreateWindow failed - %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, 0);
+    if (!renderer) {
+        fprintf(stderr, "SDL_CreateRenderer failed - %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_RendererInfo info;
+    SDL_GetRendererInfo(renderer, &info);
+    printf("renderer: %s\n", info.name);
+
+    // 直接上传的格式: 两种模式都是一次拷贝, 主要看 LockTexture 本身的开销
+    run(renderer, nb_frames, AV_PIX_FMT_YUV420P, width, height, width, height);
+    run(renderer, nb_frames, AV_PIX_FMT_NV12, width, height, width, height);
+    // 需要swscale的情况: LOCK 模式省掉中间缓冲区到纹理的那次拷贝
+    run(renderer, nb_frames, AV_PIX_FMT_YUV420P, width, height, width / 2, height / 2);
+    run(renderer, nb_frames, AV_PIX_FMT_YUYV422, width, height, width, height);
+
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return 0;
+}
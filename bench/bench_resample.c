@@ -0,0 +1,138 @@
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+#include <libavutil/time.h>
+#include <libswresample/swresample.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "resampler.h"
+
+// 重采样阶段的 micro-benchmark:
+// 对比每帧 swr_alloc/swr_init/swr_free (旧的audio_resampling写法) 与 AudioResampler 缓存.
+// 输入模拟AAC解码输出: fltp, 立体声, 每帧1024个样本.
+
+#define BENCH_NB_SAMPLES 1024
+#define BENCH_CHANNELS 2
+
+static int resample_per_frame(AVFrame* frame, enum AVSampleFormat out_sample_fmt,
+                              int out_sample_rate, uint8_t* out_buf) {
+    SwrContext* swr_ctx = swr_alloc();
+    if (!swr_ctx) {
+        return -1;
+    }
+    av_opt_set_int(swr_ctx, "in_channel_layout", frame->channel_layout, 0);
+    av_opt_set_int(swr_ctx, "in_sample_rate", frame->sample_rate, 0);
+    av_opt_set_sample_fmt(swr_ctx, "in_sample_fmt", frame->format, 0);
+    av_opt_set_int(swr_ctx, "out_channel_layout", AV_CH_LAYOUT_STEREO, 0);
+    av_opt_set_int(swr_ctx, "out_sample_rate", out_sample_rate, 0);
+    av_opt_set_sample_fmt(swr_ctx, "out_sample_fmt", out_sample_fmt, 0);
+    if (swr_init(swr_ctx) < 0) {
+        swr_free(&swr_ctx);
+        return -1;
+    }
+    int out_linesize = 0;
+    uint8_t** resampled_data = NULL;
+    int out_nb_samples = av_rescale_rnd(
+        swr_get_delay(swr_ctx, frame->sample_rate) + frame->nb_samples,
+        out_sample_rate, frame->sample_rate, AV_ROUND_UP);
+    if (av_samples_alloc_array_and_samples(&resampled_data, &out_linesize,
+            BENCH_CHANNELS, out_nb_samples, out_sample_fmt, 0) < 0) {
+        swr_free(&swr_ctx);
+        return -1;
+    }
+    int ret = swr_convert(swr_ctx, resampled_data, out_nb_samples,
+        (const uint8_t**)frame->data, frame->nb_samples);
+    int size = -1;
+    if (ret >= 0) {
+        size = av_samples_get_buffer_size(&out_linesize, BENCH_CHANNELS, ret, out_sample_fmt, 1);
+        memcpy(out_buf, resampled_data[0], size);
+    }
+    av_freep(&resampled_data[0]);
+    av_freep(&resampled_data);
+    swr_free(&swr_ctx);
+    return size;
+}
+
+static AVFrame* make_frame(int sample_rate) {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return NULL;
+    }
+    frame->format = AV_SAMPLE_FMT_FLTP;
+    frame->channel_layout = AV_CH_LAYOUT_STEREO;
+    frame->channels = BENCH_CHANNELS;
+    frame->sample_rate = sample_rate;
+    frame->nb_samples = BENCH_NB_SAMPLES;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    // 440Hz正弦波
+    for (int c = 0; c < BENCH_CHANNELS; c++) {
+        float* samples = (float*)frame->data[c];
+        for (int i = 0; i < BENCH_NB_SAMPLES; i++) {
+            samples[i] = 0.5f * sinf(2.0f * 3.14159265f * 440.0f * i / sample_rate);
+        }
+    }
+    return frame;
+}
+
+static void run(int nb_frames, int in_rate, int out_rate) {
+    static uint8_t out_buf[192000];
+    AVFrame* frame = make_frame(in_rate);
+    if (!frame) {
+        fprintf(stderr, "Could not allocate frame\n");
+        exit(1);
+    }
+
+    int64_t start = av_gettime_relative();
+    for (int i = 0; i < nb_frames; i++) {
+        if (resample_per_frame(frame, AV_SAMPLE_FMT_S16, out_rate, out_buf) < 0) {
+            fprintf(stderr, "resample_per_frame failed\n");
+            exit(1);
+        }
+    }
+    int64_t per_frame_us = av_gettime_relative() - start;
+
+    AudioResampler resampler;
+    audio_resampler_init(&resampler);
+    start = av_gettime_relative();
+    for (int i = 0; i < nb_frames; i++) {
+        uint8_t* out = NULL;
+        int size = audio_resampler_convert(&resampler, frame, AV_SAMPLE_FMT_S16,
+            BENCH_CHANNELS, out_rate, &out);
+        if (size < 0) {
+            fprintf(stderr, "audio_resampler_convert failed\n");
+            exit(1);
+        }
+        memcpy(out_buf, out, size);
+    }
+    int64_t cached_us = av_gettime_relative() - start;
+
+    printf("%d -> %d Hz, %d frames\n", in_rate, out_rate, nb_frames);
+    printf("  per-frame SwrContext: %8.1f ms %10.1f fps\n",
+        per_frame_us / 1000.0, nb_frames * 1e6 / per_frame_us);
+    printf("  cached AudioResampler: %7.1f ms %10.1f fps (rebuilds %d, buffer %u bytes)\n",
+        cached_us / 1000.0, nb_frames * 1e6 / cached_us,
+        resampler.nb_rebuilds, resampler.out_buf_size);
+    printf("  speedup: %.2fx\n", (double)per_frame_us / cached_us);
+
+    audio_resampler_free(&resampler);
+    av_frame_free(&frame);
+}
+
+int main(int argc, char* argv[]) {
+    int nb_frames = 20000;
+    if (argc > 1) {
+        sscanf(argv[1], "%d", &nb_frames);
+    }
+    // 仅格式转换(播放器的常见情况) 与 带采样率转换
+    run(nb_frames, 44100, 44100);
+    run(nb_frames, 44100, 48000);
+    return 0;
+}
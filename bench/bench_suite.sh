@@ -0,0 +1,220 @@
+#!/bin/sh
+# 可复现的性能测试: 用 lavfi(testsrc2 + sine)在本地生成固定内容的测试文件, 不依赖任何外部视频,
+# 无界面地跑 decode / demux / scale / resample / queue / dump 各阶段, 结果写成 JSON; compare 与基线比较, 有退化时返回1.
+#
+#   bench_suite.sh run <build-dir> <results.json> [data-dir]
+#   bench_suite.sh compare <baseline.json> <results.json> [threshold-percent]
+#
+# 通常由 CMake 的 bench 目标调用(cmake --build build --target bench), 配置 -DBENCH_BASELINE=<json> 时自动比较.
+# 环境变量: FFMPEG 生成测试文件用的 ffmpeg 程序(默认 PATH 里的 ffmpeg), BENCH_DURATION 测试文件时长(秒, 默认5).
+#
+# JSON 里每个指标一行: "stage.case.metric": { "value": v, "better": "higher" | "lower" },
+# compare 只按这个格式逐行解析, 不需要 JSON 工具.
+
+set -e
+
+usage() {
+    echo "Usage: $0 run <build-dir> <results.json> [data-dir]"
+    echo "       $0 compare <baseline.json> <results.json> [threshold-percent]"
+    exit 2
+}
+
+# ---- 测试文件 ----
+
+# gen_input <name> <size> <vcodec> [encoder options...]
+# 编码单线程 + bitexact, 同一版本的 ffmpeg 每次生成的文件逐字节相同; 已存在时不重新生成
+gen_input() {
+    name=$1
+    size=$2
+    vcodec=$3
+    shift 3
+    out="$DATA_DIR/$name.mp4"
+    if [ -s "$out" ]; then
+        return 0
+    fi
+    if ! "$FFMPEG" -hide_banner -encoders 2>/dev/null | grep -q " $vcodec "; then
+        echo "skip $name: encoder $vcodec not available"
+        return 0
+    fi
+    echo "generate $out"
+    "$FFMPEG" -hide_banner -loglevel error -y \
+        -f lavfi -i "testsrc2=size=$size:rate=30:duration=$DURATION" \
+        -f lavfi -i "sine=frequency=440:sample_rate=48000:duration=$DURATION" \
+        -map 0:v -map 1:a -c:v "$vcodec" "$@" -threads 1 -pix_fmt yuv420p -g 60 \
+        -c:a aac -ac 2 -b:a 128k \
+        -map_metadata -1 -fflags +bitexact -flags:v +bitexact -flags:a +bitexact \
+        "$out.tmp.mp4"
+    mv "$out.tmp.mp4" "$out"
+}
+
+generate_inputs() {
+    mkdir -p "$DATA_DIR"
+    gen_input h264_360p 640x360 libx264 -preset veryfast -bf 2
+    gen_input h264_720p 1280x720 libx264 -preset veryfast -bf 2
+    gen_input h264_1080p 1920x1080 libx264 -preset veryfast -bf 2
+    # ffmpeg 自带的编码器, 没有 libx264 时也有输入可测
+    gen_input mpeg4_720p 1280x720 mpeg4 -q:v 4
+}
+
+# ---- 结果 ----
+
+# metric <key> <value> <higher|lower>
+metric() {
+    echo "$1 $2 $3" >> "$METRICS"
+}
+
+# 把各 bench 的文本输出转成指标, 格式见各 bench_*.c 里的 printf
+run_decode() {
+    for f in "$DATA_DIR"/*.mp4; do
+        [ -e "$f" ] || continue
+        name=$(basename "$f" .mp4)
+        echo "== decode $name"
+        "$BUILD_DIR/bench/bench_decode" "$f" both:1 slice frame both | tee "$TMP/out"
+        awk -v name="$name" '$3 == "threads" && $8 == "fps" {
+            print "decode." name "." $1 ".fps " $7 " higher"
+            print "decode." name "." $1 ".cpu_ms " $13 " lower"
+            print "decode." name "." $1 ".peak_rss_mb " $18 " lower"
+            print "decode." name "." $1 ".page_faults " $21 " lower"
+        }' "$TMP/out" | sed 's/both:1/single/' >> "$METRICS"
+    done
+}
+
+# 只 demux: 默认文件协议和 mmap, 冷/热 page cache 各一次
+run_demux() {
+    for f in "$DATA_DIR"/*.mp4; do
+        [ -e "$f" ] || continue
+        name=$(basename "$f" .mp4)
+        echo "== demux $name"
+        "$BUILD_DIR/bench/bench_demux" "$f" | tee "$TMP/out"
+        awk -v name="$name" '$4 == "packets" && $6 == "packets/s" {
+            print "demux." name "." $1 "_" $2 ".packets_per_s " $5 " higher"
+            print "demux." name "." $1 "_" $2 ".cpu_ms " $13 " lower"
+        }' "$TMP/out" >> "$METRICS"
+    done
+}
+
+run_scale() {
+    echo "== scale"
+    "$BUILD_DIR/bench/bench_scale" 50 | tee "$TMP/out"
+    awk '/ -> / { sub(",", "", $5); c = $1 "_" $2 "_" $4 "_" $5 }
+         $1 == "single:" || $1 == "sliced:" { sub(":", "", $1); print "scale." c "." $1 ".fps " $4 " higher" }' \
+        "$TMP/out" >> "$METRICS"
+    echo "== yuv2rgb"
+    "$BUILD_DIR/bench/bench_yuv2rgb" 100 | tee "$TMP/out"
+    awk '/MP\/s/ && $1 != "" { print "scale.yuv2rgb." $1 ".mp_per_s " $4 " higher" }' "$TMP/out" >> "$METRICS"
+}
+
+run_resample() {
+    echo "== resample"
+    "$BUILD_DIR/bench/bench_resample" 20000 | tee "$TMP/out"
+    awk '/ Hz, / { c = $1 "_" $3 }
+         /per-frame SwrContext:/ { print "resample." c ".per_frame.fps " $5 " higher" }
+         /cached AudioResampler:/ { print "resample." c ".cached.fps " $5 " higher" }' \
+        "$TMP/out" >> "$METRICS"
+}
+
+run_queue() {
+    echo "== queue"
+    "$BUILD_DIR/bench/bench_queue" 200000 | tee "$TMP/out"
+    awk '/^throughput/ { mode = "throughput" } /^latency/ { mode = "latency" }
+         /packets\/s/ {
+             if (mode == "throughput") print "queue." $1 ".packets_per_s " $2 " higher"
+             else print "queue." $1 ".latency_p99_us " $9 " lower"
+         }' "$TMP/out" >> "$METRICS"
+}
+
+# tutorial01 整条导出流水线(解码 -> 转换 -> 编码 -> 写文件), 只在有 720p 输入时跑
+run_dump() {
+    input="$DATA_DIR/h264_720p.mp4"
+    [ -e "$input" ] || input="$DATA_DIR/mpeg4_720p.mp4"
+    [ -e "$input" ] || return 0
+    for format in qoi ppm; do
+        echo "== dump $format"
+        rm -rf "$TMP/dump"
+        mkdir -p "$TMP/dump/tmp"
+        start=$(date +%s%N)
+        (cd "$TMP/dump" && "$BUILD_DIR/tutorial01/tutorial01" "$input" 100 --output "$format") > "$TMP/out"
+        end=$(date +%s%N)
+        grep -v "read packet" "$TMP/out" | tail -n 12
+        awk -v f="$format" '$3 == "items" && $5 == "wall" {
+            print "dump." f "." $1 ".ms_per_item " $8 " lower"
+        }' "$TMP/out" >> "$METRICS"
+        metric "dump.$format.total_ms" $(( (end - start) / 1000000 )) lower
+    done
+}
+
+write_json() {
+    {
+        echo "{"
+        echo "  \"host\": \"$(uname -n)\","
+        echo "  \"cores\": $(getconf _NPROCESSORS_ONLN),"
+        echo "  \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+        echo "  \"metrics\": {"
+        awk 'NR > 1 { print line "," } { line = sprintf("    \"%s\": { \"value\": %s, \"better\": \"%s\" }", $1, $2, $3) }
+             END { if (NR) print line }' "$METRICS"
+        echo "  }"
+        echo "}"
+    } > "$RESULTS"
+    echo "wrote $(wc -l < "$METRICS") metrics to $RESULTS"
+}
+
+# ---- 比较 ----
+
+# 只比较两边都有的指标; 超过阈值变差的算退化, 退出码1
+compare() {
+    awk -v threshold="$THRESHOLD" '
+        function parse(line) {
+            if (!match(line, /"[^"]+": \{ "value": [-0-9.e+]+, "better": "(higher|lower)"/)) return 0
+            split(line, f, "\"")
+            key = f[2]; better = f[8]
+            v = line; sub(/.*"value": /, "", v); sub(/,.*/, "", v)
+            value = v + 0
+            return 1
+        }
+        FNR == NR { if (parse($0)) { base[key] = value }; next }
+        parse($0) && (key in base) {
+            old = base[key]
+            change = old != 0 ? (value - old) * 100 / old : 0
+            worse = better == "higher" ? -change : change
+            status = worse > threshold ? "REGRESSION" : (worse < -threshold ? "improved" : "ok")
+            if (status == "REGRESSION") regressions++
+            printf "%-60s %12.2f -> %12.2f %+7.1f%%  %s\n", key, old, value, change, status
+            compared++
+        }
+        END {
+            printf "%d metrics compared, %d regressions (threshold %s%%)\n", compared, regressions, threshold
+            exit (regressions > 0 ? 1 : 0)
+        }' "$BASELINE" "$RESULTS"
+}
+
+[ $# -ge 3 ] || usage
+case "$1" in
+run)
+    BUILD_DIR=$(cd "$2" && pwd)
+    RESULTS=$3
+    DATA_DIR=${4:-$BUILD_DIR/bench_data}
+    FFMPEG=${FFMPEG:-ffmpeg}
+    DURATION=${BENCH_DURATION:-5}
+    TMP=$(mktemp -d)
+    METRICS="$TMP/metrics"
+    : > "$METRICS"
+    trap 'rm -rf "$TMP"' EXIT
+    generate_inputs
+    run_decode
+    run_demux
+    run_scale
+    run_resample
+    run_queue
+    run_dump
+    write_json
+    ;;
+compare)
+    BASELINE=$2
+    RESULTS=$3
+    THRESHOLD=${4:-10}
+    compare
+    ;;
+*)
+    usage
+    ;;
+esac
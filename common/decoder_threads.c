@@ -0,0 +1,58 @@
+#include "decoder_threads.h"
+
+#include <libavutil/cpu.h>
+#include <stdio.h>
+#include <string.h>
+
+void decoder_threads_init(DecoderThreads* t) {
+    t->type = 0;
+    t->count = 0;
+}
+
+int decoder_threads_parse_type(DecoderThreads* t, const char* name) {
+    if (strcmp(name, "auto") == 0) {
+        t->type = 0;
+    } else if (strcmp(name, "frame") == 0) {
+        t->type = FF_THREAD_FRAME;
+    } else if (strcmp(name, "slice") == 0) {
+        t->type = FF_THREAD_SLICE;
+    } else if (strcmp(name, "both") == 0) {
+        t->type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+void decoder_threads_apply(const DecoderThreads* t, AVCodecContext* ctx) {
+    int cpus = av_cpu_count();
+    int count = t->count;
+    if (count <= 0) {
+        // 多核时多开一个线程, 让解析下一帧和等待前一帧的参考帧重叠; 单核不开线程
+        count = cpus > 1 ? cpus + 1 : 1;
+    }
+    if (count > DECODER_THREADS_MAX) {
+        count = DECODER_THREADS_MAX;
+    }
+    ctx->thread_count = count;
+    ctx->thread_type = t->type ? t->type : FF_THREAD_FRAME | FF_THREAD_SLICE;
+}
+
+const char* decoder_threads_type_name(int type) {
+    switch (type & (FF_THREAD_FRAME | FF_THREAD_SLICE)) {
+    case FF_THREAD_FRAME:
+        return "frame";
+    case FF_THREAD_SLICE:
+        return "slice";
+    case FF_THREAD_FRAME | FF_THREAD_SLICE:
+        return "both";
+    default:
+        return "none";
+    }
+}
+
+void decoder_threads_print(const AVCodecContext* ctx, const char* name) {
+    // active_thread_type 为0说明解码器不支持所要求的方式, 实际是单线程
+    printf("%s decoder: %d threads, requested %s, active %s\n", name, ctx->thread_count,
+        decoder_threads_type_name(ctx->thread_type), decoder_threads_type_name(ctx->active_thread_type));
+}
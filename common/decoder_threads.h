@@ -0,0 +1,31 @@
+#ifndef COMMON_DECODER_THREADS_H
+#define COMMON_DECODER_THREADS_H
+
+#include <libavcodec/avcodec.h>
+
+// 解码线程数上限, 与 FFmpeg 自动选择线程数时的上限一致; 再多 h264/hevc 也基本不会更快
+#define DECODER_THREADS_MAX 16
+
+// 解码器多线程策略, 在 avcodec_open2 之前设置到 AVCodecContext 上.
+//   frame: 帧级并行, 吞吐最高, 但每多一个线程输出就多延迟一帧
+//   slice: 片级并行, 不增加延迟, 只有编码时分了多个 slice 的流才有效
+//   both / auto: 解码器支持哪种用哪种(帧级优先), 即 FFmpeg 的默认
+// count 为0时按核数自动选择: 核数+1, 单核时为1(不开线程), 不超过 DECODER_THREADS_MAX.
+typedef struct DecoderThreads {
+    // 0 表示 auto, 否则为 FF_THREAD_FRAME / FF_THREAD_SLICE 的组合
+    int type;
+    int count;
+} DecoderThreads;
+
+// 默认 auto
+void decoder_threads_init(DecoderThreads* t);
+// 解析 "auto" / "frame" / "slice" / "both", 不认识时返回-1
+int decoder_threads_parse_type(DecoderThreads* t, const char* name);
+// 在 avcodec_open2 之前调用
+void decoder_threads_apply(const DecoderThreads* t, AVCodecContext* ctx);
+// avcodec_open2 之后打印解码器实际用的线程数和方式
+void decoder_threads_print(const AVCodecContext* ctx, const char* name);
+// 描述 thread_type 的字符串: "frame" / "slice" / "both" / "none"
+const char* decoder_threads_type_name(int type);
+
+#endif
@@ -0,0 +1,534 @@
+#define _GNU_SOURCE
+#include "file_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libavutil/time.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 不依赖 liburing, 直接用系统调用; 头文件太旧(没有 openat/close 的 file_index)时只编译 stdio 后端
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_FILE_INDEX_ALLOC
+#define HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+#if HAVE_IO_URING
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// 每个文件 openat/write/close 三个请求
+#define OPS_PER_FILE 3
+#define OP_OPEN 0
+#define OP_WRITE 1
+#define OP_CLOSE 2
+
+struct FileWriterRing {
+    int fd;
+    void* ring;
+    size_t ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_array;
+    unsigned sq_mask;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    // 注册到 ring 上, 每个完成事件加1; 其它线程也写它来唤醒 I/O 线程
+    int event_fd;
+    // 下一个可填的 SQ 位置, 以及已填还没被内核取走的请求数
+    unsigned sqe_tail;
+    unsigned to_submit;
+};
+
+static int uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// 打开的文件直接放进固定文件表(5.15), 用 linkat 是否可用来判断内核版本
+static int probe_ops(int fd) {
+    static const int required[] = { IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_WRITE_FIXED, IORING_OP_CLOSE, IORING_OP_LINKAT };
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = calloc(1, size);
+    if (!probe) {
+        return -1;
+    }
+    int ret = uring_register(fd, IORING_REGISTER_PROBE, probe, 256);
+    for (size_t i = 0; ret >= 0 && i < sizeof(required) / sizeof(required[0]); i++) {
+        if (required[i] > probe->last_op || !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED)) {
+            ret = -1;
+        }
+    }
+    free(probe);
+    return ret < 0 ? -1 : 0;
+}
+
+static void ring_free(FileWriterRing* r) {
+    if (r->event_fd >= 0) {
+        close(r->event_fd);
+    }
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->ring) {
+        munmap(r->ring, r->ring_size);
+    }
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+    free(r);
+}
+
+static FileWriterRing* ring_alloc(int nb_files) {
+    FileWriterRing* r = calloc(1, sizeof(*r));
+    if (!r) {
+        return NULL;
+    }
+    r->event_fd = -1;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = uring_setup(nb_files * OPS_PER_FILE, &p);
+    // 只支持 SQ/CQ 共用一次 mmap 的内核(5.4+), 再旧的内核本来也没有需要的操作
+    if (r->fd < 0 || !(p.features & IORING_FEAT_SINGLE_MMAP) || probe_ops(r->fd) < 0) {
+        ring_free(r);
+        return NULL;
+    }
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    r->ring = mmap(NULL, r->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->ring == MAP_FAILED) {
+        r->ring = NULL;
+        ring_free(r);
+        return NULL;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        ring_free(r);
+        return NULL;
+    }
+    uint8_t* base = r->ring;
+    r->sq_head = (unsigned*)(base + p.sq_off.head);
+    r->sq_tail = (unsigned*)(base + p.sq_off.tail);
+    r->sq_array = (unsigned*)(base + p.sq_off.array);
+    r->sq_mask = *(unsigned*)(base + p.sq_off.ring_mask);
+    r->cq_head = (unsigned*)(base + p.cq_off.head);
+    r->cq_tail = (unsigned*)(base + p.cq_off.tail);
+    r->cq_mask = *(unsigned*)(base + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(base + p.cq_off.cqes);
+    r->sqe_tail = *r->sq_tail;
+    // 每个槽位一个空的固定文件位置, openat 直接打开到这里, 不占进程的 fd
+    int fds[FILE_WRITER_MAX_BUFFERS];
+    for (int i = 0; i < nb_files; i++) {
+        fds[i] = -1;
+    }
+    if (uring_register(r->fd, IORING_REGISTER_FILES, fds, nb_files) < 0) {
+        ring_free(r);
+        return NULL;
+    }
+    r->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (r->event_fd < 0 || uring_register(r->fd, IORING_REGISTER_EVENTFD, &r->event_fd, 1) < 0) {
+        ring_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+// SQ 最多同时有 nb_slots * 3 个请求, 不会满
+static struct io_uring_sqe* ring_get_sqe(FileWriterRing* r) {
+    unsigned index = r->sqe_tail++ & r->sq_mask;
+    struct io_uring_sqe* sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sq_array[index] = index;
+    r->to_submit++;
+    return sqe;
+}
+
+static void ring_publish(FileWriterRing* r) {
+    atomic_store_explicit((atomic_uint*)r->sq_tail, r->sqe_tail, memory_order_release);
+}
+
+// 收掉所有完成事件, 返回写完(成功或失败)的文件数
+static int reap(FileWriter* w) {
+    FileWriterRing* r = w->ring;
+    int done = 0;
+    unsigned head = *r->cq_head;
+    unsigned tail = atomic_load_explicit((atomic_uint*)r->cq_tail, memory_order_acquire);
+    for (; head != tail; head++) {
+        struct io_uring_cqe* cqe = &r->cqes[head & r->cq_mask];
+        FileWriterSlot* s = &w->slots[cqe->user_data >> 2];
+        int op = cqe->user_data & 3;
+        // 短写会打断链接, 之后的 close 收到 -ECANCELED; 槽位下次 openat 时会被替换
+        if (!s->error && (cqe->res < 0 || (op == OP_WRITE && (size_t)cqe->res != s->size))) {
+            s->error = 1;
+            printf("write %s failed: %s\n", s->path, cqe->res < 0 ? strerror(-cqe->res) : "short write");
+        }
+        if (--s->pending == 0) {
+            if (s->error) {
+                w->nb_errors++;
+            } else {
+                w->nb_files++;
+                w->bytes += s->size;
+            }
+            s->state = 0;
+            done++;
+        }
+    }
+    atomic_store_explicit((atomic_uint*)r->cq_head, head, memory_order_release);
+    return done;
+}
+
+// 把排队的请求交给内核, 不等完成; 只由 I/O 线程调用
+static int ring_submit(FileWriter* w) {
+    FileWriterRing* r = w->ring;
+    ring_publish(r);
+    for (;;) {
+        int ret = uring_enter(r->fd, r->to_submit, 0, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            printf("io_uring_enter failed: %s\n", strerror(errno));
+            return -1;
+        }
+        if (r->to_submit) {
+            w->nb_submits++;
+        }
+        r->to_submit -= ret;
+        w->queued = 0;
+        break;
+    }
+    return 0;
+}
+
+// 唤醒 I/O 线程
+static void ring_notify(FileWriter* w) {
+    uint64_t one = 1;
+    while (write(w->ring->event_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+// I/O 线程: 持锁收完成事件并提交排队的文件, 然后放开锁等 eventfd(完成事件或其它线程的通知)
+static int io_thread(void* arg) {
+    FileWriter* w = (FileWriter*)arg;
+    SDL_LockMutex(w->mutex);
+    for (;;) {
+        if (reap(w) > 0) {
+            SDL_CondBroadcast(w->cond);
+        }
+        // 攒够一批, 或有线程在等缓冲区(要等的可能就在排队的文件里)时提交
+        if (w->queued > 0 && (w->queued >= w->batch || w->nb_waiters > 0)) {
+            ring_submit(w);
+        }
+        if (w->quit) {
+            break;
+        }
+        SDL_UnlockMutex(w->mutex);
+        uint64_t value;
+        while (read(w->ring->event_fd, &value, sizeof(value)) < 0 && errno == EINTR) {
+        }
+        SDL_LockMutex(w->mutex);
+    }
+    SDL_UnlockMutex(w->mutex);
+    return 0;
+}
+
+static void queue_file(FileWriter* w, int slot) {
+    FileWriterSlot* s = &w->slots[slot];
+    struct io_uring_sqe* sqe = ring_get_sqe(w->ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uintptr_t)s->path;
+    sqe->open_flags = O_WRONLY | O_CREAT | O_TRUNC;
+    sqe->len = 0644;
+    sqe->file_index = slot + 1;
+    // 打开失败时后面的写和关闭都取消
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = (uint64_t)slot << 2 | OP_OPEN;
+
+    sqe = ring_get_sqe(w->ring);
+    sqe->opcode = w->fixed_buffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = slot;
+    sqe->addr = (uintptr_t)s->data;
+    sqe->len = s->size;
+    sqe->off = 0;
+    sqe->buf_index = slot;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+    sqe->user_data = (uint64_t)slot << 2 | OP_WRITE;
+
+    sqe = ring_get_sqe(w->ring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->file_index = slot + 1;
+    sqe->user_data = (uint64_t)slot << 2 | OP_CLOSE;
+    s->pending = OPS_PER_FILE;
+    s->error = 0;
+}
+
+static void register_buffers(FileWriter* w) {
+    if (w->fixed_buffers) {
+        uring_register(w->ring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        w->fixed_buffers = 0;
+    }
+    struct iovec iov[FILE_WRITER_MAX_BUFFERS];
+    for (int i = 0; i < w->nb_slots; i++) {
+        iov[i].iov_base = w->slots[i].data;
+        iov[i].iov_len = w->capacity;
+    }
+    // 非 root 时锁定内存受 RLIMIT_MEMLOCK 限制, 注册失败就用普通 write
+    w->fixed_buffers = uring_register(w->ring->fd, IORING_REGISTER_BUFFERS, iov, w->nb_slots) == 0;
+}
+#else
+struct FileWriterRing {
+    int unused;
+};
+
+static void ring_notify(FileWriter* w) {
+    (void)w;
+}
+#endif
+
+int file_writer_init(FileWriter* w, int nb_buffers, int use_uring) {
+    memset(w, 0, sizeof(*w));
+    if (nb_buffers < 2) {
+        nb_buffers = 2;
+    } else if (nb_buffers > FILE_WRITER_MAX_BUFFERS) {
+        nb_buffers = FILE_WRITER_MAX_BUFFERS;
+    }
+    w->nb_slots = nb_buffers;
+    w->batch = nb_buffers / 2;
+    w->mutex = SDL_CreateMutex();
+    w->cond = SDL_CreateCond();
+    if (!w->mutex || !w->cond) {
+        printf("file_writer_init failed - %s\n", SDL_GetError());
+        return -1;
+    }
+#if HAVE_IO_URING
+    if (use_uring) {
+        w->ring = ring_alloc(nb_buffers);
+        if (w->ring) {
+            w->io_thread = SDL_CreateThread(io_thread, "file_writer", w);
+            if (!w->io_thread) {
+                ring_free(w->ring);
+                w->ring = NULL;
+            }
+        }
+        w->use_uring = w->ring != NULL;
+        if (!w->use_uring) {
+            printf("io_uring not available, falling back to stdio\n");
+        }
+    }
+#else
+    if (use_uring) {
+        printf("built without io_uring, falling back to stdio\n");
+    }
+#endif
+    return 0;
+}
+
+// 持锁等一次进展(有文件写完, 或持有缓冲区的线程提交/归还), 返回后调用者重新检查.
+// 不够一批的排队文件要通知 I/O 线程提交, 否则可能一直等不到
+static void wait_progress(FileWriter* w) {
+    if (w->use_uring && w->queued > 0) {
+        ring_notify(w);
+    }
+    w->nb_waiters++;
+    SDL_CondWait(w->cond, w->mutex);
+    w->nb_waiters--;
+}
+
+// 帧尺寸变大时等所有缓冲区空闲, 一起换成更大的(注册的固定缓冲区只能整体替换)
+static int grow_buffers(FileWriter* w, size_t size) {
+    for (;;) {
+        int busy = 0;
+        for (int i = 0; i < w->nb_slots; i++) {
+            if (w->slots[i].state != 0) {
+                busy = 1;
+            }
+        }
+        if (!busy) {
+            break;
+        }
+        wait_progress(w);
+    }
+    if (size <= w->capacity) {
+        return 0;
+    }
+    // 按64KB取整, 尺寸的小变化不用重新分配
+    size_t capacity = (size + 0xffff) & ~(size_t)0xffff;
+    for (int i = 0; i < w->nb_slots; i++) {
+        free(w->slots[i].data);
+        w->slots[i].data = NULL;
+        if (posix_memalign((void**)&w->slots[i].data, 4096, capacity) != 0) {
+            w->slots[i].data = NULL;
+            w->capacity = 0;
+            printf("file_writer: could not allocate %zu bytes\n", capacity);
+            return -1;
+        }
+    }
+    w->capacity = capacity;
+#if HAVE_IO_URING
+    if (w->use_uring) {
+        register_buffers(w);
+    }
+#endif
+    return 0;
+}
+
+int file_writer_acquire(FileWriter* w, size_t size, uint8_t** data) {
+    int64_t start = av_gettime_relative();
+    int waited = 0;
+    SDL_LockMutex(w->mutex);
+    if (size > w->capacity) {
+        if (grow_buffers(w, size) < 0) {
+            SDL_UnlockMutex(w->mutex);
+            return -1;
+        }
+    }
+    int slot = -1;
+    for (;;) {
+        for (int i = 0; i < w->nb_slots; i++) {
+            if (w->slots[i].state == 0) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot >= 0) {
+            break;
+        }
+        waited = 1;
+        wait_progress(w);
+    }
+    w->slots[slot].state = 1;
+    *data = w->slots[slot].data;
+    if (waited) {
+        w->nb_waits++;
+        w->wait_us += av_gettime_relative() - start;
+    }
+    SDL_UnlockMutex(w->mutex);
+    return slot;
+}
+
+static int write_stdio(const char* path, const uint8_t* data, size_t size) {
+    FILE* f = fopen(path, "wb");
+    if (!f) {
+        return -1;
+    }
+    size_t written = fwrite(data, 1, size, f);
+    return fclose(f) == 0 && written == size ? 0 : -1;
+}
+
+int file_writer_submit(FileWriter* w, int slot, const char* path, size_t size) {
+    FileWriterSlot* s = &w->slots[slot];
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    s->size = size;
+    if (!w->use_uring) {
+        int ret = write_stdio(s->path, s->data, size);
+        SDL_LockMutex(w->mutex);
+        if (ret < 0) {
+            printf("write %s failed\n", path);
+            w->nb_errors++;
+        } else {
+            w->nb_files++;
+            w->bytes += size;
+        }
+        s->state = 0;
+        SDL_CondSignal(w->cond);
+        SDL_UnlockMutex(w->mutex);
+        return ret;
+    }
+#if HAVE_IO_URING
+    SDL_LockMutex(w->mutex);
+    queue_file(w, slot);
+    s->state = 2;
+    // 攒够一批才让 I/O 线程进一次内核; 不够一批的在有线程等缓冲区时提交
+    if (++w->queued >= w->batch || w->nb_waiters > 0) {
+        ring_notify(w);
+    }
+    SDL_UnlockMutex(w->mutex);
+#endif
+    return 0;
+}
+
+void file_writer_release(FileWriter* w, int slot) {
+    SDL_LockMutex(w->mutex);
+    w->slots[slot].state = 0;
+    SDL_CondSignal(w->cond);
+    SDL_UnlockMutex(w->mutex);
+}
+
+void file_writer_flush(FileWriter* w) {
+    SDL_LockMutex(w->mutex);
+    for (;;) {
+        int busy = 0;
+        for (int i = 0; i < w->nb_slots; i++) {
+            if (w->slots[i].state != 0) {
+                busy = 1;
+            }
+        }
+        if (!busy) {
+            break;
+        }
+        wait_progress(w);
+    }
+    SDL_UnlockMutex(w->mutex);
+}
+
+void file_writer_print_stats(FileWriter* w) {
+    printf("file writer (%s%s): %lld files, %.1f MB, %lld submits, %lld waits for a free buffer (%.1f ms), %lld errors\n",
+        w->use_uring ? "io_uring" : "stdio", w->use_uring && w->fixed_buffers ? ", fixed buffers" : "",
+        (long long)w->nb_files, w->bytes / (1024.0 * 1024.0), (long long)w->nb_submits,
+        (long long)w->nb_waits, w->wait_us / 1000.0, (long long)w->nb_errors);
+}
+
+void file_writer_destroy(FileWriter* w) {
+    if (w->mutex) {
+        file_writer_flush(w);
+    }
+#if HAVE_IO_URING
+    if (w->io_thread) {
+        SDL_LockMutex(w->mutex);
+        w->quit = 1;
+        ring_notify(w);
+        SDL_UnlockMutex(w->mutex);
+        SDL_WaitThread(w->io_thread, NULL);
+        w->io_thread = NULL;
+    }
+    if (w->ring) {
+        ring_free(w->ring);
+        w->ring = NULL;
+    }
+#endif
+    for (int i = 0; i < w->nb_slots; i++) {
+        free(w->slots[i].data);
+        w->slots[i].data = NULL;
+    }
+    if (w->cond) {
+        SDL_DestroyCond(w->cond);
+        w->cond = NULL;
+    }
+    if (w->mutex) {
+        SDL_DestroyMutex(w->mutex);
+        w->mutex = NULL;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef COMMON_FILE_WRITER_H
+#define COMMON_FILE_WRITER_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FILE_WRITER_MAX_BUFFERS 16
+
+typedef struct FileWriterRing FileWriterRing;
+
+// 缓冲池里的一个缓冲区, 同时对应 io_uring 的一个固定文件槽位
+typedef struct FileWriterSlot {
+    uint8_t* data;
+    // 0空闲, 1被调用者持有(正在填数据), 2已排队/提交, 等待完成
+    int state;
+    // 还没收到的完成事件数(open/write/close 各一个)
+    int pending;
+    int error;
+    size_t size;
+    char path[256];
+} FileWriterSlot;
+
+// 整文件异步写出: 调用者从缓冲池取一个缓冲区, 填好整个文件的内容后提交,
+// 写文件线程不等存储设备, 只有缓冲池用完时才等最早的写完成.
+// io_uring 后端: 每个文件提交 openat -> write -> close 三个链接的请求, 文件用固定槽位(direct descriptor),
+// 缓冲池注册成固定缓冲区(注册失败时退回普通 write); 攒够 batch 个文件才调用一次 io_uring_enter.
+// 提交和收完成事件都由一个 I/O 线程做(不持锁等在 eventfd 上), 调用线程从不进内核等存储设备;
+// 请求属于提交它的线程, 那个线程退出时没完成的请求会被内核取消, 所以也不能由随时会退出的调用线程提交.
+// 内核不支持 io_uring(或被 seccomp 禁用)时退回 stdio, 在 submit 里同步 fopen/fwrite/fclose.
+// 多个线程可以共用一个 FileWriter.
+typedef struct FileWriter {
+    int use_uring;
+    FileWriterRing* ring;
+    // 是否注册成了固定缓冲区
+    int fixed_buffers;
+    FileWriterSlot slots[FILE_WRITER_MAX_BUFFERS];
+    int nb_slots;
+    size_t capacity;
+    // 已排队但还没 io_uring_enter 的文件数, 达到 batch 时提交
+    int queued;
+    int batch;
+    // io_uring 时的 I/O 线程; 在 cond 上等空闲缓冲区的线程数, 有人等时不够一批也提交
+    SDL_Thread* io_thread;
+    int nb_waiters;
+    int quit;
+    SDL_mutex* mutex;
+    SDL_cond* cond;
+    // 统计
+    int64_t nb_files;
+    int64_t bytes;
+    int64_t nb_submits;
+    int64_t nb_waits;
+    int64_t wait_us;
+    int64_t nb_errors;
+} FileWriter;
+
+// nb_buffers 个缓冲区(不超过 FILE_WRITER_MAX_BUFFERS); use_uring 为0时直接用 stdio. 返回0成功, -1失败
+int file_writer_init(FileWriter* w, int nb_buffers, int use_uring);
+// 取一个至少 size 字节的缓冲区, 池里没有空闲的时等待; 返回槽位号, *data 指向缓冲区
+int file_writer_acquire(FileWriter* w, size_t size, uint8_t** data);
+// 把槽位里的 size 字节写成文件 path, 之后缓冲区归还给池; 返回0成功, -1失败
+int file_writer_submit(FileWriter* w, int slot, const char* path, size_t size);
+// 不写文件, 直接归还 acquire 取到的缓冲区
+void file_writer_release(FileWriter* w, int slot);
+// 提交所有排队的文件并等全部写完
+void file_writer_flush(FileWriter* w);
+void file_writer_print_stats(FileWriter* w);
+void file_writer_destroy(FileWriter* w);
+
+#endif
@@ -0,0 +1,217 @@
+#define _DEFAULT_SOURCE
+#include "frame_allocator.h"
+
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+static int64_t page_faults(void) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) < 0) {
+        return 0;
+    }
+    return usage.ru_minflt + usage.ru_majflt;
+}
+
+int frame_allocator_init(FrameAllocator* fa, enum FrameBuffersMode mode) {
+    memset(fa, 0, sizeof(FrameAllocator));
+    fa->mode = mode;
+    atomic_init(&fa->bytes_held, 0);
+    atomic_init(&fa->huge_bytes_held, 0);
+    atomic_init(&fa->nb_gets, 0);
+    atomic_init(&fa->nb_allocs, 0);
+    atomic_init(&fa->nb_fallbacks, 0);
+    fa->start_faults = page_faults();
+    fa->mutex = SDL_CreateMutex();
+    if (!fa->mutex) {
+        printf("SDL_CreateMutex error\n");
+        return -1;
+    }
+    return 0;
+}
+
+int frame_allocator_parse_mode(const char* name) {
+    if (strcmp(name, "default") == 0) {
+        return FRAME_BUFFERS_DEFAULT;
+    } else if (strcmp(name, "pool") == 0) {
+        return FRAME_BUFFERS_POOL;
+    } else if (strcmp(name, "huge") == 0) {
+        return FRAME_BUFFERS_HUGE;
+    }
+    return -1;
+}
+
+void frame_allocator_destroy(FrameAllocator* fa) {
+    for (int i = 0; i < fa->nb_classes; i++) {
+        av_buffer_pool_uninit(&fa->classes[i].pool);
+    }
+    fa->nb_classes = 0;
+    if (fa->mutex) {
+        SDL_DestroyMutex(fa->mutex);
+        fa->mutex = NULL;
+    }
+}
+
+static void buffer_free(void* opaque, uint8_t* data) {
+    FrameAllocatorClass* c = (FrameAllocatorClass*)opaque;
+    atomic_fetch_sub(&c->allocator->bytes_held, (long long)c->alloc_size);
+    if (c->huge) {
+        atomic_fetch_sub(&c->allocator->huge_bytes_held, (long long)c->alloc_size);
+    }
+    free(data);
+}
+
+// 池里没有空闲缓冲区时由 av_buffer_pool_get 调用
+static AVBufferRef* buffer_alloc(void* opaque, int size) {
+    FrameAllocatorClass* c = (FrameAllocatorClass*)opaque;
+    FrameAllocator* fa = c->allocator;
+    void* data = NULL;
+    if (posix_memalign(&data, c->huge ? FRAME_ALLOCATOR_HUGE_PAGE : FRAME_ALLOCATOR_ALIGN, c->alloc_size) != 0) {
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if (c->huge) {
+        // 失败(内核没开THP)时仍是普通页, 不影响使用
+        madvise(data, c->alloc_size, MADV_HUGEPAGE);
+    }
+#endif
+    AVBufferRef* buf = av_buffer_create(data, size, buffer_free, c, 0);
+    if (!buf) {
+        free(data);
+        return NULL;
+    }
+    atomic_fetch_add(&fa->nb_allocs, 1);
+    atomic_fetch_add(&fa->bytes_held, (long long)c->alloc_size);
+    if (c->huge) {
+        atomic_fetch_add(&fa->huge_bytes_held, (long long)c->alloc_size);
+    }
+    return buf;
+}
+
+// 找到或创建 size 对应的档位, 档位用完时返回NULL
+static AVBufferPool* get_pool(FrameAllocator* fa, int size) {
+    AVBufferPool* pool = NULL;
+    SDL_LockMutex(fa->mutex);
+    for (int i = 0; i < fa->nb_classes; i++) {
+        if (fa->classes[i].size == size) {
+            pool = fa->classes[i].pool;
+            break;
+        }
+    }
+    if (!pool && fa->nb_classes < FRAME_ALLOCATOR_MAX_CLASSES) {
+        FrameAllocatorClass* c = &fa->classes[fa->nb_classes];
+        c->allocator = fa;
+        c->size = size;
+        c->alloc_size = FFALIGN((size_t)size, FRAME_ALLOCATOR_HUGE_PAGE);
+        c->huge = fa->mode == FRAME_BUFFERS_HUGE && c->alloc_size - size <= (size_t)size / 8;
+        if (!c->huge) {
+            c->alloc_size = size;
+        }
+        c->pool = av_buffer_pool_init2(size, c, buffer_alloc, NULL);
+        if (c->pool) {
+            pool = c->pool;
+            fa->nb_classes++;
+        }
+    }
+    SDL_UnlockMutex(fa->mutex);
+    return pool;
+}
+
+// 与 avcodec_default_get_buffer2 的布局相同: 宽高按解码器的要求对齐, linesize 再对齐到
+// FRAME_ALLOCATOR_ALIGN, 每个平面单独一个缓冲区, 末尾留出解码器越界读写的余量
+static int get_video_buffer(FrameAllocator* fa, AVCodecContext* ctx, AVFrame* frame) {
+    int w = frame->width;
+    int h = frame->height;
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    avcodec_align_dimensions2(ctx, &w, &h, linesize_align);
+    int linesize[4];
+    int unaligned;
+    do {
+        if (av_image_fill_linesizes(linesize, frame->format, w) < 0) {
+            return -1;
+        }
+        // 有平面的 linesize 没对齐时加宽再算, 和 libavcodec 的做法一样
+        w += w & ~(w - 1);
+        unaligned = 0;
+        for (int i = 0; i < 4; i++) {
+            unaligned |= linesize[i] % FFMAX(linesize_align[i], FRAME_ALLOCATOR_ALIGN);
+        }
+    } while (unaligned);
+    // 以NULL为基址算出的 data[i] 就是各平面的偏移, 后一个平面的偏移减去当前的就是平面大小
+    uint8_t* data[4];
+    int total = av_image_fill_pointers(data, frame->format, h, NULL, linesize);
+    if (total < 0) {
+        return -1;
+    }
+    int size[4];
+    int nb_planes;
+    for (nb_planes = 0; nb_planes < 3 && data[nb_planes + 1]; nb_planes++) {
+        size[nb_planes] = data[nb_planes + 1] - data[nb_planes];
+    }
+    size[nb_planes] = total - (data[nb_planes] - data[0]);
+    nb_planes++;
+    for (int i = 0; i < nb_planes; i++) {
+        AVBufferPool* pool = get_pool(fa, size[i] + 16 + FRAME_ALLOCATOR_ALIGN - 1);
+        if (!pool) {
+            return -1;
+        }
+        frame->buf[i] = av_buffer_pool_get(pool);
+        if (!frame->buf[i]) {
+            return -1;
+        }
+        atomic_fetch_add(&fa->nb_gets, 1);
+        frame->data[i] = frame->buf[i]->data;
+        frame->linesize[i] = linesize[i];
+    }
+    frame->extended_data = frame->data;
+    return 0;
+}
+
+static int frame_allocator_get_buffer2(AVCodecContext* ctx, AVFrame* frame, int flags) {
+    FrameAllocator* fa = (FrameAllocator*)ctx->opaque;
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frame->format);
+    if (ctx->codec_type == AVMEDIA_TYPE_VIDEO && desc && !(desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_PAL)) &&
+        (ctx->codec->capabilities & AV_CODEC_CAP_DR1)) {
+        if (get_video_buffer(fa, ctx, frame) == 0) {
+            return 0;
+        }
+        // 档位用完或分配失败: 放掉已取的平面, 交给默认分配器
+        for (int i = 0; i < AV_NUM_DATA_POINTERS; i++) {
+            av_buffer_unref(&frame->buf[i]);
+            frame->data[i] = NULL;
+            frame->linesize[i] = 0;
+        }
+    }
+    atomic_fetch_add(&fa->nb_fallbacks, 1);
+    return avcodec_default_get_buffer2(ctx, frame, flags);
+}
+
+void frame_allocator_attach(FrameAllocator* fa, AVCodecContext* ctx) {
+    if (fa->mode == FRAME_BUFFERS_DEFAULT) {
+        return;
+    }
+    ctx->opaque = fa;
+    ctx->get_buffer2 = frame_allocator_get_buffer2;
+#if FF_API_THREAD_SAFE_CALLBACKS
+    // 回调本身是线程安全的, 帧级多线程时不必转回主线程调用
+    ctx->thread_safe_callbacks = 1;
+#endif
+}
+
+void frame_allocator_print_stats(FrameAllocator* fa) {
+    int64_t gets = atomic_load(&fa->nb_gets);
+    int64_t allocs = atomic_load(&fa->nb_allocs);
+    if (fa->mode == FRAME_BUFFERS_DEFAULT) {
+        printf("frame buffers: libavcodec default, %lld page faults\n", (long long)(page_faults() - fa->start_faults));
+        return;
+    }
+    printf("frame buffers: %d size classes, %.1f MB held (%.1f MB huge pages), %lld buffers, %lld allocated, "
+           "%.1f%% reused, %lld default allocations, %lld page faults\n",
+        fa->nb_classes, atomic_load(&fa->bytes_held) / 1048576.0, atomic_load(&fa->huge_bytes_held) / 1048576.0,
+        (long long)gets, (long long)allocs, gets > 0 ? (gets - allocs) * 100.0 / gets : 0.0,
+        (long long)atomic_load(&fa->nb_fallbacks), (long long)(page_faults() - fa->start_faults));
+}
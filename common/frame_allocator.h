@@ -0,0 +1,64 @@
+#ifndef COMMON_FRAME_ALLOCATOR_H
+#define COMMON_FRAME_ALLOCATOR_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <libavcodec/avcodec.h>
+#include <stdatomic.h>
+
+// 同时存在的大小档位上限, 每种分辨率/像素格式的每个平面大小占一档
+#define FRAME_ALLOCATOR_MAX_CLASSES 16
+// 缓冲区起始地址和每行字节数的对齐, 够 AVX-512 整行读写
+#define FRAME_ALLOCATOR_ALIGN 64
+// 透明大页的大小; 向上取整到整数个大页浪费不超过 1/8 的缓冲区才按大页分配
+#define FRAME_ALLOCATOR_HUGE_PAGE (2 * 1024 * 1024)
+
+// default: 不接管, 用 libavcodec 自己的缓冲池; pool: 本模块的缓冲池; huge: 缓冲池 + 透明大页
+enum FrameBuffersMode {
+    FRAME_BUFFERS_DEFAULT,
+    FRAME_BUFFERS_POOL,
+    FRAME_BUFFERS_HUGE,
+};
+
+struct FrameAllocator;
+
+// 一个大小档位: 大小相同的平面共用一个 AVBufferPool
+typedef struct FrameAllocatorClass {
+    struct FrameAllocator* allocator;
+    int size;
+    // 实际分配的字节数(大页时向上取整到 FRAME_ALLOCATOR_HUGE_PAGE)
+    size_t alloc_size;
+    int huge;
+    AVBufferPool* pool;
+} FrameAllocatorClass;
+
+// 解码器的 get_buffer2: 视频帧的每个平面从按大小分档的缓冲池里取, 用完回到池里, 不再每帧 malloc/free.
+// 一个 FrameAllocator 可以挂到多个解码器上, 相同尺寸和像素格式的解码器共用同一组池.
+// 平面的起始地址和 linesize 都按 FRAME_ALLOCATOR_ALIGN 对齐; huge 模式时接近或超过2MB的缓冲区
+// (如1080p的Y平面)按2MB对齐分配并 madvise(MADV_HUGEPAGE), 大帧少很多缺页和 TLB miss.
+// 音频帧, 硬件帧, 带调色板的格式和不支持 DR1 的解码器仍用 avcodec_default_get_buffer2.
+typedef struct FrameAllocator {
+    enum FrameBuffersMode mode;
+    FrameAllocatorClass classes[FRAME_ALLOCATOR_MAX_CLASSES];
+    int nb_classes;
+    SDL_mutex* mutex;
+    // 统计: 池里分配的字节数(含借出的), 其中大页的部分; 取缓冲区次数和其中新分配的次数
+    atomic_llong bytes_held;
+    atomic_llong huge_bytes_held;
+    atomic_llong nb_gets;
+    atomic_llong nb_allocs;
+    atomic_llong nb_fallbacks;
+    // init 时进程的缺页次数, 打印统计时算差值
+    int64_t start_faults;
+} FrameAllocator;
+
+int frame_allocator_init(FrameAllocator* fa, enum FrameBuffersMode mode);
+// 解析 "default" / "pool" / "huge", 不认识时返回-1
+int frame_allocator_parse_mode(const char* name);
+// 在 avcodec_open2 之前调用, default 模式什么都不做; fa 要在解码器关闭后才能 destroy
+void frame_allocator_attach(FrameAllocator* fa, AVCodecContext* ctx);
+// 池在最后一个借出的缓冲区释放后才真正释放内存
+void frame_allocator_destroy(FrameAllocator* fa);
+void frame_allocator_print_stats(FrameAllocator* fa);
+
+#endif
@@ -0,0 +1,138 @@
+#include "frame_queue.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int frame_queue_init(FrameQueue* q, int max_size) {
+    memset(q, 0, sizeof(FrameQueue));
+    if (max_size <= 0 || max_size > FRAME_QUEUE_MAX_SIZE) {
+        max_size = FRAME_QUEUE_MAX_SIZE;
+    }
+    q->max_size = max_size;
+    for (int i = 0; i < q->max_size; i++) {
+        q->frames[i] = av_frame_alloc();
+        if (!q->frames[i]) {
+            printf("av_frame_alloc error\n");
+            frame_queue_destroy(q);
+            return -1;
+        }
+    }
+    q->mutex = SDL_CreateMutex();
+    if (!q->mutex) {
+        printf("SDL_CreateMutex error\n");
+        frame_queue_destroy(q);
+        return -1;
+    }
+    q->cond = SDL_CreateCond();
+    if (!q->cond) {
+        printf("SDL_CreateCond error\n");
+        frame_queue_destroy(q);
+        return -1;
+    }
+    return 0;
+}
+
+void frame_queue_destroy(FrameQueue* q) {
+    for (int i = 0; i < q->max_size; i++) {
+        av_frame_free(&q->frames[i]);
+    }
+    if (q->cond) {
+        SDL_DestroyCond(q->cond);
+        q->cond = NULL;
+    }
+    if (q->mutex) {
+        SDL_DestroyMutex(q->mutex);
+        q->mutex = NULL;
+    }
+}
+
+void frame_queue_abort(FrameQueue* q) {
+    SDL_LockMutex(q->mutex);
+    q->abort_request = 1;
+    SDL_CondBroadcast(q->cond);
+    SDL_UnlockMutex(q->mutex);
+}
+
+int frame_queue_put(FrameQueue* q, AVFrame* src) {
+    SDL_LockMutex(q->mutex);
+    while (q->size >= q->max_size && !q->abort_request) {
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    if (q->abort_request) {
+        SDL_UnlockMutex(q->mutex);
+        return -1;
+    }
+    SDL_UnlockMutex(q->mutex);
+
+    // 写槽位只有生产者会碰, 不需要持锁
+    av_frame_move_ref(q->frames[q->windex], src);
+    if (++q->windex == q->max_size) {
+        q->windex = 0;
+    }
+
+    SDL_LockMutex(q->mutex);
+    q->size++;
+    SDL_CondSignal(q->cond);
+    SDL_UnlockMutex(q->mutex);
+    return 0;
+}
+
+AVFrame* frame_queue_peek(FrameQueue* q, int timeout_ms) {
+    SDL_LockMutex(q->mutex);
+    if (q->size <= 0 && !q->abort_request && timeout_ms > 0) {
+        SDL_CondWaitTimeout(q->cond, q->mutex, timeout_ms);
+    }
+    AVFrame* frame = NULL;
+    if (q->size > 0 && !q->abort_request) {
+        frame = q->frames[q->rindex];
+    }
+    SDL_UnlockMutex(q->mutex);
+    return frame;
+}
+
+void frame_queue_next(FrameQueue* q) {
+    av_frame_unref(q->frames[q->rindex]);
+    if (++q->rindex == q->max_size) {
+        q->rindex = 0;
+    }
+    SDL_LockMutex(q->mutex);
+    q->size--;
+    SDL_CondSignal(q->cond);
+    SDL_UnlockMutex(q->mutex);
+}
+
+int frame_queue_get(FrameQueue* q, AVFrame* dst) {
+    SDL_LockMutex(q->mutex);
+    while (q->size <= 0 && !q->finished && !q->abort_request) {
+        SDL_CondWait(q->cond, q->mutex);
+    }
+    if (q->abort_request || q->size <= 0) {
+        int ret = q->abort_request ? -1 : 0;
+        SDL_UnlockMutex(q->mutex);
+        return ret;
+    }
+    // 多个消费者共享读下标, 出队要在锁内完成
+    av_frame_move_ref(dst, q->frames[q->rindex]);
+    if (++q->rindex == q->max_size) {
+        q->rindex = 0;
+    }
+    q->size--;
+    // 等待者可能是生产者也可能是其他消费者, 全部唤醒
+    SDL_CondBroadcast(q->cond);
+    SDL_UnlockMutex(q->mutex);
+    return 1;
+}
+
+void frame_queue_finish(FrameQueue* q) {
+    SDL_LockMutex(q->mutex);
+    q->finished = 1;
+    SDL_CondBroadcast(q->cond);
+    SDL_UnlockMutex(q->mutex);
+}
+
+int frame_queue_nb_remaining(FrameQueue* q) {
+    SDL_LockMutex(q->mutex);
+    int size = q->size;
+    SDL_UnlockMutex(q->mutex);
+    return size;
+}
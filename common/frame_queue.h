@@ -0,0 +1,43 @@
+#ifndef COMMON_FRAME_QUEUE_H
+#define COMMON_FRAME_QUEUE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <libavutil/frame.h>
+
+#define FRAME_QUEUE_MAX_SIZE 16
+
+// 解码后帧的有界队列(解码线程 -> 渲染循环).
+// 槽位里的 AVFrame 预先分配, put 用 av_frame_move_ref 接管解码器输出的引用;
+// 渲染端 peek 拿到队首帧, 用完后 next 释放引用并前移.
+// 帧的处理耗时远大于加锁开销, 这里直接用 mutex/cond.
+// 多个消费者(如导出线程池)时改用 get, 在锁内取走队首帧; 生产者写完后调用 finish.
+typedef struct FrameQueue {
+    AVFrame* frames[FRAME_QUEUE_MAX_SIZE];
+    int max_size;
+    int rindex;
+    int windex;
+    int size;
+    int abort_request;
+    int finished;
+    SDL_mutex* mutex;
+    SDL_cond* cond;
+} FrameQueue;
+
+int frame_queue_init(FrameQueue* q, int max_size);
+void frame_queue_destroy(FrameQueue* q);
+// 接管 src 的引用(调用后 src 被重置), 队列满时阻塞; 返回0成功, -1表示已abort
+int frame_queue_put(FrameQueue* q, AVFrame* src);
+// 返回队首帧但不出队; 队列为空时最多等 timeout_ms (0为不等待), 超时或abort返回NULL
+AVFrame* frame_queue_peek(FrameQueue* q, int timeout_ms);
+// 释放队首帧并出队
+void frame_queue_next(FrameQueue* q);
+int frame_queue_nb_remaining(FrameQueue* q);
+// 多消费者使用: 取走队首帧的引用到 dst, 队列为空时阻塞;
+// 返回1取到帧, 0表示已finish且取空, -1表示已abort
+int frame_queue_get(FrameQueue* q, AVFrame* dst);
+// 生产者不再写入, 消费者取空后 get 返回0
+void frame_queue_finish(FrameQueue* q);
+void frame_queue_abort(FrameQueue* q);
+
+#endif
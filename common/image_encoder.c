@@ -0,0 +1,216 @@
+#include "image_encoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define QOI_OP_INDEX 0x00
+#define QOI_OP_DIFF 0x40
+#define QOI_OP_LUMA 0x80
+#define QOI_OP_RUN 0xc0
+#define QOI_OP_RGB 0xfe
+#define QOI_HEADER_SIZE 14
+#define QOI_PADDING_SIZE 8
+
+int image_format_from_name(const char* name) {
+    if (strcmp(name, "ppm") == 0) {
+        return IMAGE_PPM;
+    } else if (strcmp(name, "qoi") == 0) {
+        return IMAGE_QOI;
+    } else if (strcmp(name, "png") == 0) {
+        return IMAGE_PNG;
+    }
+    return -1;
+}
+
+const char* image_format_extension(ImageFormat format) {
+    switch (format) {
+    case IMAGE_QOI:
+        return "qoi";
+    case IMAGE_PNG:
+        return "png";
+    default:
+        return "ppm";
+    }
+}
+
+size_t image_encode_bound(ImageFormat format, int width, int height) {
+    size_t pixels = (size_t)width * height;
+    switch (format) {
+    case IMAGE_QOI:
+        // 最坏每个像素一个 QOI_OP_RGB(4字节)
+        return QOI_HEADER_SIZE + pixels * 4 + QOI_PADDING_SIZE;
+    case IMAGE_PNG:
+        // 签名 + IHDR + IDAT 头尾 + IEND, 数据部分每行多一个滤波类型字节
+        return 8 + 25 + 12 + compressBound((uLong)((width * 3 + 1) * (size_t)height)) + 12;
+    default:
+        return 32 + pixels * 3;
+    }
+}
+
+static uint8_t* put_be32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+    return p + 4;
+}
+
+static int64_t encode_ppm(const uint8_t* rgb, int stride, int width, int height, uint8_t* out, size_t capacity) {
+    int header_size = snprintf((char*)out, capacity, "P6\n%d %d\n255\n", width, height);
+    if (header_size < 0 || header_size + (size_t)width * 3 * height > capacity) {
+        return -1;
+    }
+    for (int y = 0; y < height; y++) {
+        memcpy(out + header_size + (size_t)y * width * 3, rgb + (size_t)y * stride, width * 3);
+    }
+    return header_size + (int64_t)width * 3 * height;
+}
+
+// https://qoiformat.org/qoi-specification.pdf, 3通道, alpha 恒为255
+static int64_t encode_qoi(const uint8_t* rgb, int stride, int width, int height, uint8_t* out, size_t capacity) {
+    if (capacity < image_encode_bound(IMAGE_QOI, width, height)) {
+        return -1;
+    }
+    uint8_t* p = out;
+    memcpy(p, "qoif", 4);
+    p = put_be32(p + 4, width);
+    p = put_be32(p, height);
+    *p++ = 3;
+    *p++ = 0;
+    // 像素打包成 0xffrrggbb 比较; 哈希中 alpha 的一项是常数 255 * 11
+    uint32_t index[64];
+    memset(index, 0, sizeof(index));
+    uint32_t prev = 0xff000000;
+    int run = 0;
+    for (int y = 0; y < height; y++) {
+        const uint8_t* src = rgb + (size_t)y * stride;
+        for (int x = 0; x < width; x++, src += 3) {
+            uint32_t px = 0xff000000 | src[0] << 16 | src[1] << 8 | src[2];
+            if (px == prev) {
+                if (++run == 62) {
+                    *p++ = QOI_OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                *p++ = QOI_OP_RUN | (run - 1);
+                run = 0;
+            }
+            int r = src[0], g = src[1], b = src[2];
+            int h = (r * 3 + g * 5 + b * 7 + 255 * 11) & 63;
+            if (index[h] == px) {
+                *p++ = QOI_OP_INDEX | h;
+            } else {
+                index[h] = px;
+                int8_t dr = (int8_t)(r - (int)(prev >> 16 & 0xff));
+                int8_t dg = (int8_t)(g - (int)(prev >> 8 & 0xff));
+                int8_t db = (int8_t)(b - (int)(prev & 0xff));
+                int8_t dr_dg = (int8_t)(dr - dg);
+                int8_t db_dg = (int8_t)(db - dg);
+                if ((uint8_t)(dr + 2) < 4 && (uint8_t)(dg + 2) < 4 && (uint8_t)(db + 2) < 4) {
+                    *p++ = QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2);
+                } else if ((uint8_t)(dg + 32) < 64 && (uint8_t)(dr_dg + 8) < 16 && (uint8_t)(db_dg + 8) < 16) {
+                    *p++ = QOI_OP_LUMA | (dg + 32);
+                    *p++ = (dr_dg + 8) << 4 | (db_dg + 8);
+                } else {
+                    *p++ = QOI_OP_RGB;
+                    *p++ = r;
+                    *p++ = g;
+                    *p++ = b;
+                }
+            }
+            prev = px;
+        }
+    }
+    if (run > 0) {
+        *p++ = QOI_OP_RUN | (run - 1);
+    }
+    memset(p, 0, QOI_PADDING_SIZE - 1);
+    p[QOI_PADDING_SIZE - 1] = 1;
+    p += QOI_PADDING_SIZE;
+    return p - out;
+}
+
+// chunk 数据已经写在 p + 8 处, 补上长度/类型和 CRC, 返回 chunk 之后的位置
+static uint8_t* finish_chunk(uint8_t* p, const char* type, uint32_t length) {
+    put_be32(p, length);
+    memcpy(p + 4, type, 4);
+    uint32_t crc = crc32(0, p + 4, 4 + length);
+    return put_be32(p + 8 + length, crc);
+}
+
+static int64_t encode_png(const uint8_t* rgb, int stride, int width, int height, uint8_t* out, size_t capacity) {
+    size_t row_size = (size_t)width * 3 + 1;
+    if (capacity < image_encode_bound(IMAGE_PNG, width, height)) {
+        return -1;
+    }
+    uint8_t* row = malloc(row_size);
+    if (!row) {
+        return -1;
+    }
+    uint8_t* p = out;
+    memcpy(p, "\x89PNG\r\n\x1a\n", 8);
+    p += 8;
+    uint8_t* ihdr = p + 8;
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 8; // 位深
+    ihdr[9] = 2; // RGB
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    p = finish_chunk(p, "IHDR", 13);
+
+    // 整幅图一个 IDAT, deflate 直接输出到 chunk 的数据区
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, 1) != Z_OK) {
+        free(row);
+        return -1;
+    }
+    uint8_t* idat = p;
+    zs.next_out = idat + 8;
+    zs.avail_out = (uInt)(out + capacity - zs.next_out - 12 - 4);
+    int ret = Z_OK;
+    for (int y = 0; y < height && ret == Z_OK; y++) {
+        const uint8_t* src = rgb + (size_t)y * stride;
+        // 第一行不滤波, 其余行用 Up(减去上一行), 可以向量化, 对视频帧效果与自适应滤波差不多
+        if (y == 0) {
+            row[0] = 0;
+            memcpy(row + 1, src, width * 3);
+        } else {
+            const uint8_t* above = src - stride;
+            row[0] = 2;
+            for (int x = 0; x < width * 3; x++) {
+                row[x + 1] = src[x] - above[x];
+            }
+        }
+        zs.next_in = row;
+        zs.avail_in = (uInt)row_size;
+        ret = deflate(&zs, y == height - 1 ? Z_FINISH : Z_NO_FLUSH);
+    }
+    uint32_t length = (uint32_t)zs.total_out;
+    deflateEnd(&zs);
+    free(row);
+    if (ret != Z_STREAM_END) {
+        return -1;
+    }
+    p = finish_chunk(idat, "IDAT", length);
+    p = finish_chunk(p, "IEND", 0);
+    return p - out;
+}
+
+int64_t image_encode(ImageFormat format, const uint8_t* rgb, int stride, int width, int height,
+                     uint8_t* out, size_t capacity) {
+    switch (format) {
+    case IMAGE_QOI:
+        return encode_qoi(rgb, stride, width, height, out, capacity);
+    case IMAGE_PNG:
+        return encode_png(rgb, stride, width, height, out, capacity);
+    default:
+        return encode_ppm(rgb, stride, width, height, out, capacity);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef COMMON_IMAGE_ENCODER_H
+#define COMMON_IMAGE_ENCODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// RGB24 单帧图片编码, 直接编码进调用者的缓冲区(如 file_writer 的缓冲池), 由各导出线程并行调用.
+//   PPM: 不压缩, 1080p 一帧约6MB
+//   QOI: 无损, 单遍扫描, 速度接近 memcpy, 一般是 PPM 的 1/3 ~ 1/2
+//   PNG: 无损, zlib deflate 压缩级别1 + 每行 Up 滤波, 比 QOI 小一些但慢得多
+typedef enum ImageFormat {
+    IMAGE_PPM,
+    IMAGE_QOI,
+    IMAGE_PNG,
+} ImageFormat;
+
+// 按名字("ppm"/"qoi"/"png")查格式, 不认识时返回-1
+int image_format_from_name(const char* name);
+const char* image_format_extension(ImageFormat format);
+// 编码结果的最大字节数, 按这个大小分配输出缓冲区
+size_t image_encode_bound(ImageFormat format, int width, int height);
+// 返回编码后的字节数, 失败返回-1
+int64_t image_encode(ImageFormat format, const uint8_t* rgb, int stride, int width, int height,
+                     uint8_t* out, size_t capacity);
+
+#endif
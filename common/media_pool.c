@@ -0,0 +1,119 @@
+#include "media_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int media_pool_init(MediaPool* pool, const char* name, int nb_packets, int nb_frames) {
+    memset(pool, 0, sizeof(MediaPool));
+    pool->name = name;
+    nb_packets = FFMIN(nb_packets, MEDIA_POOL_MAX_SIZE);
+    nb_frames = FFMIN(nb_frames, MEDIA_POOL_MAX_SIZE);
+    for (; pool->nb_free_packets < nb_packets; pool->nb_free_packets++) {
+        pool->packets[pool->nb_free_packets] = av_packet_alloc();
+        if (!pool->packets[pool->nb_free_packets]) {
+            printf("av_packet_alloc error\n");
+            return -1;
+        }
+    }
+    for (; pool->nb_free_frames < nb_frames; pool->nb_free_frames++) {
+        pool->frames[pool->nb_free_frames] = av_frame_alloc();
+        if (!pool->frames[pool->nb_free_frames]) {
+            printf("av_frame_alloc error\n");
+            return -1;
+        }
+    }
+    pool->mutex = SDL_CreateMutex();
+    if (!pool->mutex) {
+        printf("SDL_CreateMutex error\n");
+        return -1;
+    }
+    return 0;
+}
+
+void media_pool_destroy(MediaPool* pool) {
+    for (int i = 0; i < pool->nb_free_packets; i++) {
+        av_packet_free(&pool->packets[i]);
+    }
+    pool->nb_free_packets = 0;
+    for (int i = 0; i < pool->nb_free_frames; i++) {
+        av_frame_free(&pool->frames[i]);
+    }
+    pool->nb_free_frames = 0;
+    if (pool->mutex) {
+        SDL_DestroyMutex(pool->mutex);
+        pool->mutex = NULL;
+    }
+}
+
+AVPacket* media_pool_get_packet(MediaPool* pool) {
+    AVPacket* packet = NULL;
+    SDL_LockMutex(pool->mutex);
+    pool->packet_gets++;
+    if (pool->nb_free_packets > 0) {
+        packet = pool->packets[--pool->nb_free_packets];
+        pool->packet_hits++;
+    } else {
+        pool->packet_allocs++;
+    }
+    SDL_UnlockMutex(pool->mutex);
+    if (!packet) {
+        packet = av_packet_alloc();
+    }
+    return packet;
+}
+
+AVFrame* media_pool_get_frame(MediaPool* pool) {
+    AVFrame* frame = NULL;
+    SDL_LockMutex(pool->mutex);
+    pool->frame_gets++;
+    if (pool->nb_free_frames > 0) {
+        frame = pool->frames[--pool->nb_free_frames];
+        pool->frame_hits++;
+    } else {
+        pool->frame_allocs++;
+    }
+    SDL_UnlockMutex(pool->mutex);
+    if (!frame) {
+        frame = av_frame_alloc();
+    }
+    return frame;
+}
+
+void media_pool_put_packet(MediaPool* pool, AVPacket** packet) {
+    if (!*packet) {
+        return;
+    }
+    // 在锁外释放引用, 可能要释放数据缓冲区
+    av_packet_unref(*packet);
+    SDL_LockMutex(pool->mutex);
+    if (pool->nb_free_packets < MEDIA_POOL_MAX_SIZE) {
+        pool->packets[pool->nb_free_packets++] = *packet;
+        *packet = NULL;
+    }
+    SDL_UnlockMutex(pool->mutex);
+    av_packet_free(packet);
+}
+
+void media_pool_put_frame(MediaPool* pool, AVFrame** frame) {
+    if (!*frame) {
+        return;
+    }
+    av_frame_unref(*frame);
+    SDL_LockMutex(pool->mutex);
+    if (pool->nb_free_frames < MEDIA_POOL_MAX_SIZE) {
+        pool->frames[pool->nb_free_frames++] = *frame;
+        *frame = NULL;
+    }
+    SDL_UnlockMutex(pool->mutex);
+    av_frame_free(frame);
+}
+
+void media_pool_print_stats(MediaPool* pool) {
+    printf("%s pool: packets %lld gets, %.1f%% hit, %lld allocated after init; "
+           "frames %lld gets, %.1f%% hit, %lld allocated after init\n",
+        pool->name,
+        (long long)pool->packet_gets, pool->packet_gets > 0 ? pool->packet_hits * 100.0 / pool->packet_gets : 0.0,
+        (long long)pool->packet_allocs,
+        (long long)pool->frame_gets, pool->frame_gets > 0 ? pool->frame_hits * 100.0 / pool->frame_gets : 0.0,
+        (long long)pool->frame_allocs);
+}
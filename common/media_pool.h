@@ -0,0 +1,45 @@
+#ifndef COMMON_MEDIA_POOL_H
+#define COMMON_MEDIA_POOL_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+
+// 每种上限: 一条流同时在用的 packet/frame 不会超过这个数
+#define MEDIA_POOL_MAX_SIZE 16
+
+// 单条流的 AVPacket/AVFrame 对象池.
+// init 时预先分配, get 从空闲列表取, put 时 av_packet_unref/av_frame_unref 后放回,
+// 热路径上不再 av_packet_alloc/av_frame_alloc. 空闲列表为空时才现分配一个(计为未命中),
+// 预分配的数量够用时, 热身之后的分配次数应该为0.
+// 一条流的 demux/解码线程可能同时使用, 用 mutex 保护; 每次只是取放一个指针, 不会有竞争.
+typedef struct MediaPool {
+    const char* name;
+    AVPacket* packets[MEDIA_POOL_MAX_SIZE];
+    int nb_free_packets;
+    AVFrame* frames[MEDIA_POOL_MAX_SIZE];
+    int nb_free_frames;
+    SDL_mutex* mutex;
+    // 统计: get 次数, 其中从空闲列表取到的次数, init 之后现分配的个数
+    int64_t packet_gets;
+    int64_t packet_hits;
+    int64_t packet_allocs;
+    int64_t frame_gets;
+    int64_t frame_hits;
+    int64_t frame_allocs;
+} MediaPool;
+
+// 预分配 nb_packets 个 packet 和 nb_frames 个 frame(都不超过 MEDIA_POOL_MAX_SIZE)
+int media_pool_init(MediaPool* pool, const char* name, int nb_packets, int nb_frames);
+void media_pool_destroy(MediaPool* pool);
+// 取一个空的 packet/frame, 分配失败返回NULL
+AVPacket* media_pool_get_packet(MediaPool* pool);
+AVFrame* media_pool_get_frame(MediaPool* pool);
+// 释放引用后放回池里(池满时直接释放), *packet / *frame 置为NULL
+void media_pool_put_packet(MediaPool* pool, AVPacket** packet);
+void media_pool_put_frame(MediaPool* pool, AVFrame** frame);
+// 打印命中率和热身之后的分配次数
+void media_pool_print_stats(MediaPool* pool);
+
+#endif
@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE
+#include "mmap_input.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 把读位置前方 MMAP_INPUT_READAHEAD 之内还没提示过的部分 MADV_WILLNEED,
+// 每次至少推进半个窗口, 避免每个读回调都做一次系统调用
+static void mmap_input_readahead(MmapInput* in) {
+    size_t end = FFMIN(in->pos + MMAP_INPUT_READAHEAD, in->size);
+    // seek 到了提示过的范围之外(向前跳过, 或向后退出一个窗口以上)时从读位置重新开始
+    if (in->advised < in->pos || in->advised > end) {
+        in->advised = in->pos;
+    }
+    if (end < in->size && end - in->advised < MMAP_INPUT_READAHEAD / 2) {
+        return;
+    }
+    if (end > in->advised) {
+        // madvise 的地址要按页对齐
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t start = in->advised & ~(page - 1);
+        madvise(in->data + start, end - start, MADV_WILLNEED);
+        in->advised = end;
+    }
+}
+
+static int mmap_input_read(void* opaque, uint8_t* buf, int buf_size) {
+    MmapInput* in = (MmapInput*)opaque;
+    if (in->pos >= in->size) {
+        return AVERROR_EOF;
+    }
+    int len = (int)FFMIN((size_t)buf_size, in->size - in->pos);
+    mmap_input_readahead(in);
+    memcpy(buf, in->data + in->pos, len);
+    in->pos += len;
+    in->nb_reads++;
+    in->read_bytes += len;
+    return len;
+}
+
+static int64_t mmap_input_seek(void* opaque, int64_t offset, int whence) {
+    MmapInput* in = (MmapInput*)opaque;
+    int64_t pos;
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return in->size;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = (int64_t)in->pos + offset;
+        break;
+    case SEEK_END:
+        pos = (int64_t)in->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    // 允许停在文件末尾, 之后的读返回EOF
+    if (pos < 0 || pos > (int64_t)in->size) {
+        return AVERROR(EINVAL);
+    }
+    in->pos = pos;
+    in->nb_seeks++;
+    return pos;
+}
+
+// 映射文件并创建 AVIOContext, 失败时已清理干净
+static int mmap_input_map(MmapInput* in, const char* path) {
+    in->fd = open(path, O_RDONLY);
+    if (in->fd < 0) {
+        printf("mmap input: could not open %s - %s\n", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(in->fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        printf("mmap input: %s is not a regular non-empty file\n", path);
+        mmap_input_close(in);
+        return -1;
+    }
+    in->size = st.st_size;
+    void* data = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+    if (data == MAP_FAILED) {
+        printf("mmap input: mmap %s failed - %s\n", path, strerror(errno));
+        mmap_input_close(in);
+        return -1;
+    }
+    in->data = data;
+    madvise(in->data, in->size, MADV_SEQUENTIAL);
+    mmap_input_readahead(in);
+    uint8_t* buffer = av_malloc(MMAP_INPUT_IO_BUFFER_SIZE);
+    if (buffer) {
+        in->avio = avio_alloc_context(buffer, MMAP_INPUT_IO_BUFFER_SIZE, 0, in, mmap_input_read, NULL, mmap_input_seek);
+    }
+    if (!in->avio) {
+        printf("mmap input: avio_alloc_context failed\n");
+        av_free(buffer);
+        mmap_input_close(in);
+        return -1;
+    }
+    return 0;
+}
+
+int mmap_input_open(MmapInput* in, const char* path, int use_mmap, AVFormatContext** pFormatCtx) {
+    memset(in, 0, sizeof(MmapInput));
+    in->fd = -1;
+    *pFormatCtx = NULL;
+    if (use_mmap && mmap_input_map(in, path) == 0) {
+        *pFormatCtx = avformat_alloc_context();
+        if (!*pFormatCtx) {
+            mmap_input_close(in);
+            return AVERROR(ENOMEM);
+        }
+        // 自定义IO: avformat_close_input 不会释放 pb, 由 mmap_input_close 释放
+        (*pFormatCtx)->pb = in->avio;
+        (*pFormatCtx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+    } else if (use_mmap) {
+        printf("mmap input: falling back to the file protocol\n");
+    }
+    int ret = avformat_open_input(pFormatCtx, path, NULL, NULL);
+    if (ret < 0) {
+        mmap_input_close(in);
+    }
+    return ret;
+}
+
+void mmap_input_close(MmapInput* in) {
+    if (in->avio) {
+        av_freep(&in->avio->buffer);
+        avio_context_free(&in->avio);
+    }
+    if (in->data) {
+        munmap(in->data, in->size);
+        in->data = NULL;
+    }
+    if (in->fd >= 0) {
+        close(in->fd);
+        in->fd = -1;
+    }
+}
+
+void mmap_input_print_stats(const MmapInput* in) {
+    if (!in->data) {
+        printf("input: file protocol\n");
+        return;
+    }
+    printf("input: mmap %.1f MB, %lld reads, %.1f MB read, %lld seeks\n", in->size / 1048576.0,
+        (long long)in->nb_reads, in->read_bytes / 1048576.0, (long long)in->nb_seeks);
+}
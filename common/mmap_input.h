@@ -0,0 +1,39 @@
+#ifndef COMMON_MMAP_INPUT_H
+#define COMMON_MMAP_INPUT_H
+
+#include <libavformat/avformat.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// AVIOContext 的缓冲区大小; 读回调只是 memcpy, 大一点能减少回调次数
+#define MMAP_INPUT_IO_BUFFER_SIZE (256 * 1024)
+// 读到的位置之前提前 MADV_WILLNEED 的窗口
+#define MMAP_INPUT_READAHEAD (8 * 1024 * 1024)
+
+// 把输入文件整个 mmap, 用自定义 AVIOContext 给 libavformat 提供数据:
+// 读和 seek 都只是在映射上移动位置并 memcpy 到 AVIOContext 的缓冲区, 没有 read()/lseek() 系统调用,
+// 原来内核里的拷贝变成用户态的一次 memcpy. 映射整体 MADV_SEQUENTIAL, 读位置前方的
+// MMAP_INPUT_READAHEAD 按窗口 MADV_WILLNEED, 让内核提前读盘.
+// 只适用于普通文件; 管道, 网络地址等映射不了时退回默认的文件协议.
+typedef struct MmapInput {
+    int fd;
+    uint8_t* data;
+    size_t size;
+    size_t pos;
+    // 已经 MADV_WILLNEED 到的位置
+    size_t advised;
+    AVIOContext* avio;
+    // 统计: 读回调次数, 读出的字节数, seek 次数
+    int64_t nb_reads;
+    int64_t read_bytes;
+    int64_t nb_seeks;
+} MmapInput;
+
+// 同 avformat_open_input 打开 *pFormatCtx; use_mmap 时先映射 path, 映射失败打印原因后退回默认的文件协议,
+// in->data 为NULL表示没有用映射. 返回 avformat_open_input 的返回值
+int mmap_input_open(MmapInput* in, const char* path, int use_mmap, AVFormatContext** pFormatCtx);
+// 在 avformat_close_input 之后调用
+void mmap_input_close(MmapInput* in);
+void mmap_input_print_stats(const MmapInput* in);
+
+#endif
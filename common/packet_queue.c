@@ -0,0 +1,180 @@
+#include "packet_queue.h"
+
+#include <libavutil/mathematics.h>
+#include <stdio.h>
+#include <string.h>
+
+int packet_queue_init(PacketQueue* q, int capacity) {
+    memset(q, 0, sizeof(PacketQueue));
+    if (capacity <= 0) {
+        capacity = PACKET_QUEUE_DEFAULT_CAPACITY;
+    }
+    unsigned int cap = 1;
+    while (cap < (unsigned int)capacity) {
+        cap <<= 1;
+    }
+    q->slots = av_calloc(cap, sizeof(AVPacket*));
+    if (!q->slots) {
+        printf("PacketQueue slots alloc error\n");
+        return -1;
+    }
+    q->capacity = cap;
+    for (unsigned int i = 0; i < cap; i++) {
+        q->slots[i] = av_packet_alloc();
+        if (!q->slots[i]) {
+            printf("PacketQueue slots alloc error\n");
+            packet_queue_destroy(q);
+            return -1;
+        }
+    }
+    q->mask = cap - 1;
+    atomic_init(&q->write_index, 0);
+    atomic_init(&q->read_index, 0);
+    atomic_init(&q->nb_packets, 0);
+    atomic_init(&q->size, 0);
+    atomic_init(&q->duration, 0);
+    q->time_base = AV_TIME_BASE_Q;
+    atomic_init(&q->consumer_waiting, 0);
+    atomic_init(&q->producer_waiting, 0);
+    atomic_init(&q->abort_request, 0);
+    q->mutex = SDL_CreateMutex();
+    if (!q->mutex) {
+        printf("SDL_CreateMutex error\n");
+        packet_queue_destroy(q);
+        return -1;
+    }
+    q->cond = SDL_CreateCond();
+    if (!q->cond) {
+        printf("SDL_CreateCond error\n");
+        packet_queue_destroy(q);
+        return -1;
+    }
+    return 0;
+}
+
+void packet_queue_destroy(PacketQueue* q) {
+    if (q->slots) {
+        for (unsigned int i = 0; i < q->capacity; i++) {
+            av_packet_free(&q->slots[i]);
+        }
+        av_freep(&q->slots);
+    }
+    if (q->cond) {
+        SDL_DestroyCond(q->cond);
+        q->cond = NULL;
+    }
+    if (q->mutex) {
+        SDL_DestroyMutex(q->mutex);
+        q->mutex = NULL;
+    }
+}
+
+void packet_queue_set_limits(PacketQueue* q, int max_size, int64_t max_duration, AVRational time_base) {
+    q->max_size = max_size;
+    q->max_duration = max_duration;
+    q->time_base = time_base;
+}
+
+void packet_queue_abort(PacketQueue* q) {
+    SDL_LockMutex(q->mutex);
+    atomic_store(&q->abort_request, 1);
+    SDL_CondBroadcast(q->cond);
+    SDL_UnlockMutex(q->mutex);
+}
+
+// 睡眠前先置 waiting 标志, fence 之后再检查一次下标; 和 packet_queue_wake 里
+// "发布下标, fence, 读标志" 配对: 两边至少有一边能看到对方的写, 不会丢失唤醒
+static void packet_queue_prepare_wait(atomic_int* waiting) {
+    atomic_store_explicit(waiting, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+// 发布下标之后调用: 对端正在(或准备)睡眠时才去碰mutex
+static void packet_queue_wake(PacketQueue* q, atomic_int* waiting) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed)) {
+        SDL_LockMutex(q->mutex);
+        SDL_CondBroadcast(q->cond);
+        SDL_UnlockMutex(q->mutex);
+    }
+}
+
+static int64_t packet_duration_us(PacketQueue* q, const AVPacket* pkt) {
+    if (pkt->duration <= 0) {
+        return 0;
+    }
+    return av_rescale_q(pkt->duration, q->time_base, AV_TIME_BASE_Q);
+}
+
+static int packet_queue_full(PacketQueue* q, unsigned int write_index) {
+    unsigned int nb = write_index - atomic_load_explicit(&q->read_index, memory_order_acquire);
+    if (nb >= q->capacity) {
+        return 1;
+    }
+    if (nb == 0) {
+        return 0;
+    }
+    if (q->max_size > 0 && atomic_load_explicit(&q->size, memory_order_relaxed) >= q->max_size) {
+        return 1;
+    }
+    if (q->max_duration > 0 && atomic_load_explicit(&q->duration, memory_order_relaxed) >= q->max_duration) {
+        return 1;
+    }
+    return 0;
+}
+
+static int packet_queue_empty(PacketQueue* q, unsigned int read_index) {
+    return atomic_load_explicit(&q->write_index, memory_order_acquire) == read_index;
+}
+
+int packet_queue_put(PacketQueue* q, AVPacket* packet) {
+    unsigned int write_index = atomic_load_explicit(&q->write_index, memory_order_relaxed);
+    if (packet_queue_full(q, write_index)) {
+        SDL_LockMutex(q->mutex);
+        packet_queue_prepare_wait(&q->producer_waiting);
+        while (!atomic_load(&q->abort_request) && packet_queue_full(q, write_index)) {
+            SDL_CondWait(q->cond, q->mutex);
+        }
+        atomic_store(&q->producer_waiting, 0);
+        SDL_UnlockMutex(q->mutex);
+    }
+    if (atomic_load_explicit(&q->abort_request, memory_order_relaxed)) {
+        return -1;
+    }
+    int size = packet->size;
+    int64_t duration = packet_duration_us(q, packet);
+    av_packet_move_ref(q->slots[write_index & q->mask], packet);
+    atomic_fetch_add_explicit(&q->nb_packets, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&q->size, size, memory_order_relaxed);
+    atomic_fetch_add_explicit(&q->duration, duration, memory_order_relaxed);
+    atomic_store_explicit(&q->write_index, write_index + 1, memory_order_release);
+    packet_queue_wake(q, &q->consumer_waiting);
+    return 0;
+}
+
+int packet_queue_get(PacketQueue* q, AVPacket* pkt, int block) {
+    unsigned int read_index = atomic_load_explicit(&q->read_index, memory_order_relaxed);
+    if (packet_queue_empty(q, read_index)) {
+        if (!block) {
+            return atomic_load(&q->abort_request) ? -1 : 0;
+        }
+        SDL_LockMutex(q->mutex);
+        packet_queue_prepare_wait(&q->consumer_waiting);
+        while (!atomic_load(&q->abort_request) && packet_queue_empty(q, read_index)) {
+            SDL_CondWait(q->cond, q->mutex);
+        }
+        atomic_store(&q->consumer_waiting, 0);
+        SDL_UnlockMutex(q->mutex);
+    }
+    if (atomic_load_explicit(&q->abort_request, memory_order_relaxed)) {
+        return -1;
+    }
+    AVPacket* slot = q->slots[read_index & q->mask];
+    atomic_fetch_sub_explicit(&q->nb_packets, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&q->size, slot->size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&q->duration, packet_duration_us(q, slot), memory_order_relaxed);
+    av_packet_move_ref(pkt, slot);
+    atomic_store_explicit(&q->read_index, read_index + 1, memory_order_release);
+    packet_queue_wake(q, &q->producer_waiting);
+    return 1;
+}
@@ -0,0 +1,66 @@
+#ifndef COMMON_PACKET_QUEUE_H
+#define COMMON_PACKET_QUEUE_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <libavcodec/avcodec.h>
+#include <stdatomic.h>
+
+#define PACKET_QUEUE_CACHELINE 64
+// 默认容量, 按包数计算
+#define PACKET_QUEUE_DEFAULT_CAPACITY 1024
+// 默认上限: 字节数 / 时长(微秒), 0表示不限制
+#define PACKET_QUEUE_DEFAULT_MAX_SIZE (15 * 1024 * 1024)
+#define PACKET_QUEUE_DEFAULT_MAX_DURATION (10 * AV_TIME_BASE)
+
+// 单生产者/单消费者的定长环形队列.
+// 槽位的 AVPacket 在 init 时用 av_packet_alloc 预先分配(sizeof(AVPacket) 不属于公开ABI, 不能按数组分配),
+// put/get 只用 av_packet_move_ref 移动packet引用, 不再为每个包 av_malloc 链表节点;
+// 读写下标各占一条cache line, 只有在队列空(消费者)或满(生产者)时才进入 mutex/cond 等待.
+//
+// 环形结构(capacity = 8):
+//     read_index                write_index
+//         v                          v
+//   [ ][ ][p1][p2][p3][p4][p5][ ]
+// 下标只增不减, 取槽位时 & mask.
+typedef struct PacketQueue {
+    // 生产者独占写
+    _Alignas(PACKET_QUEUE_CACHELINE) atomic_uint write_index;
+    // 消费者独占写
+    _Alignas(PACKET_QUEUE_CACHELINE) atomic_uint read_index;
+
+    _Alignas(PACKET_QUEUE_CACHELINE) AVPacket** slots;
+    unsigned int capacity;
+    unsigned int mask;
+    // 队列中的包数, 字节数和总时长(微秒), 两端都会修改
+    atomic_int nb_packets;
+    atomic_int size;
+    atomic_llong duration;
+    // 背压上限: 超过任意一个时 put 阻塞, 直到消费者取走数据
+    int max_size;
+    int64_t max_duration;
+    // 用于把 pkt->duration 换算成微秒
+    AVRational time_base;
+
+    // 慢路径: 队列空/满时的阻塞等待
+    atomic_int consumer_waiting;
+    atomic_int producer_waiting;
+    atomic_int abort_request;
+    SDL_mutex* mutex;
+    SDL_cond* cond;
+} PacketQueue;
+
+// capacity 会被向上取整为2的幂, <= 0 时使用 PACKET_QUEUE_DEFAULT_CAPACITY
+int packet_queue_init(PacketQueue* q, int capacity);
+void packet_queue_destroy(PacketQueue* q);
+// 设置字节数/时长(微秒)上限, time_base 是入队packet的时间基; 上限为0表示不限制.
+// 队列为空时总是允许放入一个包, 避免单个超大包卡死.
+void packet_queue_set_limits(PacketQueue* q, int max_size, int64_t max_duration, AVRational time_base);
+// 接管 packet 的引用(调用后 packet 被重置), 队列满或超过上限时阻塞; 返回0成功, -1表示已abort
+int packet_queue_put(PacketQueue* q, AVPacket* packet);
+// 返回1取到包, 0表示非阻塞且队列为空, -1表示已abort
+int packet_queue_get(PacketQueue* q, AVPacket* pkt, int block);
+// 唤醒所有等待者, 之后 put/get 都立即返回-1
+void packet_queue_abort(PacketQueue* q);
+
+#endif
@@ -0,0 +1,96 @@
+#include "pcm_ring.h"
+
+#include <SDL2/SDL.h>
+#include <libavutil/mem.h>
+#include <stdio.h>
+#include <string.h>
+
+// 缓冲区满时解码线程每次等待的时间
+#define PCM_RING_WAIT_MS 2
+
+int pcm_ring_init(PcmRing* r, unsigned int capacity) {
+    memset(r, 0, sizeof(PcmRing));
+    r->data = av_malloc(capacity);
+    if (!r->data) {
+        printf("PcmRing alloc error\n");
+        return -1;
+    }
+    r->capacity = capacity;
+    atomic_init(&r->write_pos, 0);
+    atomic_init(&r->read_pos, 0);
+    atomic_init(&r->abort_request, 0);
+    atomic_init(&r->underruns, 0);
+    atomic_init(&r->underrun_bytes, 0);
+    return 0;
+}
+
+void pcm_ring_destroy(PcmRing* r) {
+    av_freep(&r->data);
+}
+
+void pcm_ring_abort(PcmRing* r) {
+    atomic_store(&r->abort_request, 1);
+}
+
+unsigned int pcm_ring_fill(PcmRing* r) {
+    uint64_t read_pos = atomic_load_explicit(&r->read_pos, memory_order_acquire);
+    return (unsigned int)(atomic_load_explicit(&r->write_pos, memory_order_acquire) - read_pos);
+}
+
+int pcm_ring_write(PcmRing* r, const uint8_t* buf, int len) {
+    uint64_t write_pos = atomic_load_explicit(&r->write_pos, memory_order_relaxed);
+    int written = 0;
+    while (written < len) {
+        if (atomic_load_explicit(&r->abort_request, memory_order_relaxed)) {
+            return -1;
+        }
+        uint64_t read_pos = atomic_load_explicit(&r->read_pos, memory_order_acquire);
+        unsigned int space = r->capacity - (unsigned int)(write_pos - read_pos);
+        if (space == 0) {
+            SDL_Delay(PCM_RING_WAIT_MS);
+            continue;
+        }
+        unsigned int n = len - written;
+        if (n > space) {
+            n = space;
+        }
+        // 可能跨越缓冲区末尾, 分两段拷贝
+        unsigned int offset = write_pos % r->capacity;
+        unsigned int first = r->capacity - offset;
+        if (first > n) {
+            first = n;
+        }
+        memcpy(r->data + offset, buf + written, first);
+        memcpy(r->data, buf + written + first, n - first);
+        write_pos += n;
+        written += n;
+        atomic_store_explicit(&r->write_pos, write_pos, memory_order_release);
+    }
+    return written;
+}
+
+int pcm_ring_read(PcmRing* r, uint8_t* stream, int len, uint8_t silence) {
+    uint64_t read_pos = atomic_load_explicit(&r->read_pos, memory_order_relaxed);
+    unsigned int avail = (unsigned int)(atomic_load_explicit(&r->write_pos, memory_order_acquire) - read_pos);
+    unsigned int n = len;
+    if (n > avail) {
+        n = avail;
+    }
+    unsigned int offset = read_pos % r->capacity;
+    unsigned int first = r->capacity - offset;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(stream, r->data + offset, first);
+    memcpy(stream + first, r->data, n - first);
+    atomic_store_explicit(&r->read_pos, read_pos + n, memory_order_release);
+    if (n < (unsigned int)len) {
+        memset(stream + n, silence, len - n);
+    }
+    // 还没写入过任何数据(刚启动)时不算 underrun
+    if (n < (unsigned int)len && read_pos + n > 0) {
+        atomic_fetch_add_explicit(&r->underruns, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&r->underrun_bytes, len - n, memory_order_relaxed);
+    }
+    return n;
+}
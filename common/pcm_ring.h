@@ -0,0 +1,35 @@
+#ifndef COMMON_PCM_RING_H
+#define COMMON_PCM_RING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define PCM_RING_CACHELINE 64
+
+// 解码后PCM数据的单生产者/单消费者字节环形缓冲区.
+// 生产者是音频解码线程, 消费者是SDL音频回调:
+// 回调里只做 memcpy, 不加锁也不阻塞, 数据不够时补静音并记一次 underrun;
+// 解码线程在缓冲区满时短暂 sleep 等待回调消费.
+typedef struct PcmRing {
+    _Alignas(PCM_RING_CACHELINE) atomic_uint_fast64_t write_pos;
+    _Alignas(PCM_RING_CACHELINE) atomic_uint_fast64_t read_pos;
+
+    _Alignas(PCM_RING_CACHELINE) uint8_t* data;
+    unsigned int capacity;
+    atomic_int abort_request;
+    // 统计: 回调数据不足的次数 / 补的静音字节数
+    atomic_int underruns;
+    atomic_llong underrun_bytes;
+} PcmRing;
+
+int pcm_ring_init(PcmRing* r, unsigned int capacity);
+void pcm_ring_destroy(PcmRing* r);
+// 写入全部 len 字节, 空间不足时等待; 返回写入字节数, -1 表示已abort
+int pcm_ring_write(PcmRing* r, const uint8_t* buf, int len);
+// 回调使用: 拷贝最多 len 字节, 不足部分填 silence 并计一次 underrun, 返回实际拷贝的字节数
+int pcm_ring_read(PcmRing* r, uint8_t* stream, int len, uint8_t silence);
+// 当前缓冲的字节数
+unsigned int pcm_ring_fill(PcmRing* r);
+void pcm_ring_abort(PcmRing* r);
+
+#endif
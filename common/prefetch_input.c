@@ -0,0 +1,259 @@
+#include "prefetch_input.h"
+
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <string.h>
+
+// src 的中断回调: 关闭时让阻塞在读/seek 上的预读线程返回
+static int prefetch_input_interrupt(void* opaque) {
+    PrefetchInput* in = (PrefetchInput*)opaque;
+    return atomic_load(&in->abort_request);
+}
+
+static int prefetch_thread(void* arg) {
+    PrefetchInput* in = (PrefetchInput*)arg;
+    // src 当前的读位置, 和下一次要读的位置不同(seek 过)时先 seek; -1 表示不确定
+    int64_t src_pos = 0;
+    size_t min_read = FFMIN((size_t)PREFETCH_INPUT_MIN_READ, in->capacity);
+    SDL_LockMutex(in->mutex);
+    while (!atomic_load(&in->abort_request)) {
+        size_t space = in->capacity - in->fill;
+        if (in->eof || in->error || space < min_read) {
+            SDL_CondWait(in->space_cond, in->mutex);
+            continue;
+        }
+        int generation = in->generation;
+        int64_t offset = in->pos + (int64_t)in->fill;
+        size_t tail = (in->head + in->fill) % in->capacity;
+        int len = (int)FFMIN(FFMIN(space, in->capacity - tail), (size_t)PREFETCH_INPUT_CHUNK);
+        // 读源时不持锁, 读回调可以继续消费已缓冲的数据; 写入的是环里空闲的部分, 读回调不会碰
+        SDL_UnlockMutex(in->mutex);
+        int64_t start = av_gettime_relative();
+        int ret = 0;
+        if (src_pos != offset) {
+            int64_t pos = avio_seek(in->src, offset, SEEK_SET);
+            ret = pos < 0 ? (int)pos : 0;
+        }
+        if (ret >= 0) {
+            ret = avio_read(in->src, in->data + tail, len);
+        }
+        int64_t elapsed = av_gettime_relative() - start;
+        src_pos = ret > 0 ? offset + ret : -1;
+        SDL_LockMutex(in->mutex);
+        in->max_src_read_us = FFMAX(in->max_src_read_us, elapsed);
+        if (in->generation != generation) {
+            // 读的过程中 seek 清空了缓冲区, 这次读到的数据作废
+            continue;
+        }
+        if (ret > 0) {
+            in->fill += ret;
+            in->prefetched_bytes += ret;
+        } else if (ret == 0 || ret == AVERROR_EOF) {
+            in->eof = 1;
+        } else {
+            in->error = ret;
+        }
+        SDL_CondSignal(in->data_cond);
+    }
+    SDL_UnlockMutex(in->mutex);
+    return 0;
+}
+
+static int prefetch_input_read(void* opaque, uint8_t* buf, int buf_size) {
+    PrefetchInput* in = (PrefetchInput*)opaque;
+    SDL_LockMutex(in->mutex);
+    in->nb_reads++;
+    // 读到文件末尾时缓冲区自然会空, 不计入占用
+    if (!in->eof) {
+        in->nb_fill_samples++;
+        in->fill_sum += in->fill;
+        in->min_fill = FFMIN(in->min_fill, in->fill);
+    }
+    if (in->fill == 0 && !in->eof && !in->error) {
+        int64_t start = av_gettime_relative();
+        while (in->fill == 0 && !in->eof && !in->error && !atomic_load(&in->abort_request)) {
+            SDL_CondWait(in->data_cond, in->mutex);
+        }
+        int64_t waited = av_gettime_relative() - start;
+        in->nb_stalls++;
+        in->stall_us += waited;
+        in->max_stall_us = FFMAX(in->max_stall_us, waited);
+    }
+    int ret;
+    if (in->fill > 0) {
+        size_t len = FFMIN((size_t)buf_size, in->fill);
+        // 可能跨越环的末尾, 分两段拷贝
+        size_t first = FFMIN(len, in->capacity - in->head);
+        memcpy(buf, in->data + in->head, first);
+        memcpy(buf + first, in->data, len - first);
+        in->head = (in->head + len) % in->capacity;
+        in->fill -= len;
+        in->pos += len;
+        ret = (int)len;
+        SDL_CondSignal(in->space_cond);
+    } else {
+        ret = in->error ? in->error : AVERROR_EOF;
+    }
+    SDL_UnlockMutex(in->mutex);
+    return ret;
+}
+
+static int64_t prefetch_input_seek(void* opaque, int64_t offset, int whence) {
+    PrefetchInput* in = (PrefetchInput*)opaque;
+    whence &= ~AVSEEK_FORCE;
+    if (whence == AVSEEK_SIZE) {
+        return in->size;
+    }
+    SDL_LockMutex(in->mutex);
+    int64_t pos;
+    switch (whence) {
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = in->pos + offset;
+        break;
+    case SEEK_END:
+        pos = in->size >= 0 ? in->size + offset : -1;
+        break;
+    default:
+        pos = -1;
+        break;
+    }
+    if (pos < 0) {
+        SDL_UnlockMutex(in->mutex);
+        return AVERROR(EINVAL);
+    }
+    in->nb_seeks++;
+    if (pos >= in->pos && pos <= in->pos + (int64_t)in->fill) {
+        // 目标已经在缓冲区里(如跳过不需要的box), 丢掉前面的部分即可
+        size_t skip = (size_t)(pos - in->pos);
+        in->head = (in->head + skip) % in->capacity;
+        in->fill -= skip;
+        in->nb_buffered_seeks++;
+    } else {
+        in->head = 0;
+        in->fill = 0;
+        in->eof = 0;
+        in->error = 0;
+        in->generation++;
+    }
+    in->pos = pos;
+    SDL_CondSignal(in->space_cond);
+    SDL_UnlockMutex(in->mutex);
+    return pos;
+}
+
+// 打开源, 分配缓冲区并启动预读线程; 失败时由调用者 prefetch_input_close 清理
+static int prefetch_input_start(PrefetchInput* in, const char* path, int buffer_mb) {
+    if (buffer_mb > PREFETCH_INPUT_MAX_MB) {
+        printf("prefetch input: buffer limited to %d MB\n", PREFETCH_INPUT_MAX_MB);
+        buffer_mb = PREFETCH_INPUT_MAX_MB;
+    }
+    in->capacity = (size_t)buffer_mb * 1024 * 1024;
+    in->min_fill = in->capacity;
+    in->data = av_malloc(in->capacity);
+    in->mutex = SDL_CreateMutex();
+    in->data_cond = SDL_CreateCond();
+    in->space_cond = SDL_CreateCond();
+    if (!in->data || !in->mutex || !in->data_cond || !in->space_cond) {
+        printf("prefetch input: could not allocate a %d MB buffer\n", buffer_mb);
+        return AVERROR(ENOMEM);
+    }
+    AVIOInterruptCB interrupt = { prefetch_input_interrupt, in };
+    int ret = avio_open2(&in->src, path, AVIO_FLAG_READ, &interrupt, NULL);
+    if (ret < 0) {
+        printf("prefetch input: could not open %s - %s\n", path, av_err2str(ret));
+        return ret;
+    }
+    in->size = avio_size(in->src);
+    uint8_t* buffer = av_malloc(PREFETCH_INPUT_IO_BUFFER_SIZE);
+    if (buffer) {
+        in->avio = avio_alloc_context(buffer, PREFETCH_INPUT_IO_BUFFER_SIZE, 0, in, prefetch_input_read, NULL,
+            prefetch_input_seek);
+    }
+    if (!in->avio) {
+        printf("prefetch input: avio_alloc_context failed\n");
+        av_free(buffer);
+        return AVERROR(ENOMEM);
+    }
+    // 管道, 直播流等源本身不能 seek 时, 只能在缓冲区里 seek
+    if (!(in->src->seekable & AVIO_SEEKABLE_NORMAL)) {
+        in->avio->seekable = 0;
+    }
+    in->thread = SDL_CreateThread(prefetch_thread, "prefetch", in);
+    if (!in->thread) {
+        printf("prefetch input: could not create thread - %s\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+int prefetch_input_open(PrefetchInput* in, const char* path, int buffer_mb, AVFormatContext** pFormatCtx) {
+    memset(in, 0, sizeof(PrefetchInput));
+    atomic_init(&in->abort_request, 0);
+    *pFormatCtx = NULL;
+    if (buffer_mb > 0) {
+        int ret = prefetch_input_start(in, path, buffer_mb);
+        if (ret < 0) {
+            prefetch_input_close(in);
+            return ret;
+        }
+        *pFormatCtx = avformat_alloc_context();
+        if (!*pFormatCtx) {
+            prefetch_input_close(in);
+            return AVERROR(ENOMEM);
+        }
+        // 自定义IO: avformat_close_input 不会释放 pb, 由 prefetch_input_close 释放
+        (*pFormatCtx)->pb = in->avio;
+        (*pFormatCtx)->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    int ret = avformat_open_input(pFormatCtx, path, NULL, NULL);
+    if (ret < 0) {
+        prefetch_input_close(in);
+    }
+    return ret;
+}
+
+void prefetch_input_close(PrefetchInput* in) {
+    if (in->thread) {
+        atomic_store(&in->abort_request, 1);
+        SDL_LockMutex(in->mutex);
+        SDL_CondSignal(in->space_cond);
+        SDL_UnlockMutex(in->mutex);
+        SDL_WaitThread(in->thread, NULL);
+        in->thread = NULL;
+    }
+    if (in->avio) {
+        av_freep(&in->avio->buffer);
+        avio_context_free(&in->avio);
+    }
+    avio_closep(&in->src);
+    if (in->data_cond) {
+        SDL_DestroyCond(in->data_cond);
+        in->data_cond = NULL;
+    }
+    if (in->space_cond) {
+        SDL_DestroyCond(in->space_cond);
+        in->space_cond = NULL;
+    }
+    if (in->mutex) {
+        SDL_DestroyMutex(in->mutex);
+        in->mutex = NULL;
+    }
+    av_freep(&in->data);
+}
+
+void prefetch_input_print_stats(const PrefetchInput* in) {
+    if (!in->capacity) {
+        printf("input: file protocol\n");
+        return;
+    }
+    double avg_fill = in->nb_fill_samples > 0 ? (double)in->fill_sum / in->nb_fill_samples : 0.0;
+    printf("input: prefetch %zu MB, %lld reads, %lld stalls (%.1f ms, max %.1f ms), occupancy avg %.1f%% min %.1f%%, "
+           "%lld seeks (%lld in buffer), %.1f MB prefetched, slowest source read %.1f ms\n",
+        in->capacity / (1024 * 1024), (long long)in->nb_reads, (long long)in->nb_stalls, in->stall_us / 1000.0,
+        in->max_stall_us / 1000.0, avg_fill * 100.0 / in->capacity,
+        in->nb_fill_samples > 0 ? in->min_fill * 100.0 / in->capacity : 0.0, (long long)in->nb_seeks,
+        (long long)in->nb_buffered_seeks, in->prefetched_bytes / 1048576.0, in->max_src_read_us / 1000.0);
+}
@@ -0,0 +1,70 @@
+#ifndef COMMON_PREFETCH_INPUT_H
+#define COMMON_PREFETCH_INPUT_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <libavformat/avformat.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// 预读线程每次从源读的最大字节数
+#define PREFETCH_INPUT_CHUNK (1024 * 1024)
+// 环里空出这么多才再读一次, 避免一次次地读小块
+#define PREFETCH_INPUT_MIN_READ (64 * 1024)
+// libavformat 那一侧 AVIOContext 的缓冲区大小, 读回调只是从环里 memcpy
+#define PREFETCH_INPUT_IO_BUFFER_SIZE (64 * 1024)
+// 缓冲区大小上限(MB), av_malloc 一次最多分配 INT_MAX 字节
+#define PREFETCH_INPUT_MAX_MB 1024
+
+// 预读线程把输入(本地文件或 libavformat 支持的任意协议)顺序读进一个大环形缓冲区,
+// libavformat 通过自定义 AVIOContext 只从内存读: 慢存储(如网络挂载)上偶尔几十毫秒的读延迟
+// 被缓冲区吸收, 不再卡住 demux 循环.
+// seek 落在缓冲的数据里时只移动读位置; 否则清空缓冲区, 预读线程从新位置重新读.
+// 统计 demux 侧读回调等数据的次数和时间(stall), 以及每次读回调时缓冲区的占用.
+typedef struct PrefetchInput {
+    AVIOContext* src;
+    AVIOContext* avio;
+    SDL_Thread* thread;
+    SDL_mutex* mutex;
+    // 有新数据(或EOF/出错)时通知读回调; 有空位或 seek 清空缓冲区时通知预读线程
+    SDL_cond* data_cond;
+    SDL_cond* space_cond;
+    uint8_t* data;
+    size_t capacity;
+    // 缓冲区第一个字节的文件偏移, 它在环里的下标, 缓冲的字节数
+    int64_t pos;
+    size_t head;
+    size_t fill;
+    // 源的大小, 未知时 <0; 只在打开时查一次, 之后 src 只由预读线程使用
+    int64_t size;
+    // seek 清空缓冲区时加1, 预读线程据此丢弃清空前开始读的数据
+    int generation;
+    int eof;
+    int error;
+    // 也是 src 的中断回调检查的标志, 关闭时让阻塞在读上的预读线程尽快返回
+    atomic_int abort_request;
+    // 统计: 读回调次数, 其中等数据的次数, 等待的总时间和最长一次
+    int64_t nb_reads;
+    int64_t nb_stalls;
+    int64_t stall_us;
+    int64_t max_stall_us;
+    // 读回调时(还没到EOF)缓冲区占用的采样: 次数, 总和, 最小值
+    int64_t nb_fill_samples;
+    int64_t fill_sum;
+    size_t min_fill;
+    // seek 次数和其中落在缓冲区里的次数, 预读的字节数, 预读线程单次读源的最长时间
+    int64_t nb_seeks;
+    int64_t nb_buffered_seeks;
+    int64_t prefetched_bytes;
+    int64_t max_src_read_us;
+} PrefetchInput;
+
+// 同 avformat_open_input 打开 *pFormatCtx; buffer_mb > 0 时启动预读线程, 缓冲区 buffer_mb MB,
+// 否则直接用默认的文件协议. 返回 avformat_open_input 的返回值
+int prefetch_input_open(PrefetchInput* in, const char* path, int buffer_mb, AVFormatContext** pFormatCtx);
+// 在 avformat_close_input 之后调用, 停止预读线程
+void prefetch_input_close(PrefetchInput* in);
+void prefetch_input_print_stats(const PrefetchInput* in);
+
+#endif
@@ -0,0 +1,134 @@
+#include "resampler.h"
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <stdio.h>
+#include <string.h>
+
+void audio_resampler_init(AudioResampler* r) {
+    memset(r, 0, sizeof(AudioResampler));
+    r->in_sample_fmt = AV_SAMPLE_FMT_NONE;
+    r->out_sample_fmt = AV_SAMPLE_FMT_NONE;
+}
+
+void audio_resampler_free(AudioResampler* r) {
+    if (r->swr_ctx) {
+        swr_free(&r->swr_ctx);
+    }
+    av_freep(&r->out_buf);
+    r->out_buf_size = 0;
+}
+
+static int64_t frame_channel_layout(const AVFrame* frame) {
+    if (frame->channel_layout &&
+        frame->channels == av_get_channel_layout_nb_channels(frame->channel_layout)) {
+        return frame->channel_layout;
+    }
+    return av_get_default_channel_layout(frame->channels);
+}
+
+static int64_t out_layout_for_channels(int out_channels) {
+    if (out_channels == 1) {
+        return AV_CH_LAYOUT_MONO;
+    } else if (out_channels == 2) {
+        return AV_CH_LAYOUT_STEREO;
+    }
+    return AV_CH_LAYOUT_SURROUND;
+}
+
+// 输入或输出格式和缓存的不一致时重建SwrContext
+static int audio_resampler_setup(AudioResampler* r, int64_t in_channel_layout,
+                                 int in_sample_rate, enum AVSampleFormat in_sample_fmt,
+                                 int64_t out_channel_layout, int out_sample_rate,
+                                 enum AVSampleFormat out_sample_fmt) {
+    if (r->swr_ctx &&
+        r->in_channel_layout == in_channel_layout &&
+        r->in_sample_rate == in_sample_rate &&
+        r->in_sample_fmt == in_sample_fmt &&
+        r->out_channel_layout == out_channel_layout &&
+        r->out_sample_rate == out_sample_rate &&
+        r->out_sample_fmt == out_sample_fmt) {
+        return 0;
+    }
+    if (r->swr_ctx) {
+        swr_free(&r->swr_ctx);
+    }
+    r->swr_ctx = swr_alloc_set_opts(NULL,
+        out_channel_layout, out_sample_fmt, out_sample_rate,
+        in_channel_layout, in_sample_fmt, in_sample_rate,
+        0, NULL);
+    if (!r->swr_ctx) {
+        fprintf(stderr, "Could not allocate resampler context\n");
+        return -1;
+    }
+    int ret = swr_init(r->swr_ctx);
+    if (ret < 0) {
+        fprintf(stderr, "Error initializing the resampling context\n");
+        swr_free(&r->swr_ctx);
+        return -1;
+    }
+    r->in_channel_layout = in_channel_layout;
+    r->in_sample_rate = in_sample_rate;
+    r->in_sample_fmt = in_sample_fmt;
+    r->out_channel_layout = out_channel_layout;
+    r->out_nb_channels = av_get_channel_layout_nb_channels(out_channel_layout);
+    r->out_sample_rate = out_sample_rate;
+    r->out_sample_fmt = out_sample_fmt;
+    r->nb_rebuilds++;
+    return 0;
+}
+
+int audio_resampler_convert(AudioResampler* r, const AVFrame* frame,
+                            enum AVSampleFormat out_sample_fmt,
+                            int out_channels, int out_sample_rate,
+                            uint8_t** out) {
+    // 输出为单个交错缓冲区, 不支持planar格式
+    if (av_sample_fmt_is_planar(out_sample_fmt)) {
+        fprintf(stderr, "audio_resampler: planar output format is not supported\n");
+        return -1;
+    }
+    if (frame->nb_samples <= 0) {
+        printf("in_nb_samples error.\n");
+        return -1;
+    }
+    int64_t in_channel_layout = frame_channel_layout(frame);
+    if (in_channel_layout <= 0) {
+        printf("in_channel_layout error.\n");
+        return -1;
+    }
+    int ret = audio_resampler_setup(r, in_channel_layout, frame->sample_rate,
+        frame->format, out_layout_for_channels(out_channels),
+        out_sample_rate, out_sample_fmt);
+    if (ret < 0) {
+        return -1;
+    }
+    // 算上重采样器内部积压的样本
+    int out_nb_samples = av_rescale_rnd(
+        swr_get_delay(r->swr_ctx, frame->sample_rate) + frame->nb_samples,
+        out_sample_rate, frame->sample_rate, AV_ROUND_UP);
+    if (out_nb_samples <= 0) {
+        fprintf(stderr, "Could not allocate out_nb_samples\n");
+        return -1;
+    }
+    int out_size = av_samples_get_buffer_size(NULL, r->out_nb_channels,
+        out_nb_samples, out_sample_fmt, 1);
+    if (out_size < 0) {
+        fprintf(stderr, "av_samples_get_buffer_size() failed\n");
+        return -1;
+    }
+    // 只在需要更大空间时才重新分配
+    av_fast_malloc(&r->out_buf, &r->out_buf_size, out_size);
+    if (!r->out_buf) {
+        fprintf(stderr, "Error allocating the resampler data buffers\n");
+        return -1;
+    }
+    ret = swr_convert(r->swr_ctx, &r->out_buf, out_nb_samples,
+        (const uint8_t**)frame->extended_data, frame->nb_samples);
+    if (ret < 0) {
+        fprintf(stderr, "swr_convert() failed\n");
+        return -1;
+    }
+    *out = r->out_buf;
+    return av_samples_get_buffer_size(NULL, r->out_nb_channels, ret, out_sample_fmt, 1);
+}
@@ -0,0 +1,37 @@
+#ifndef COMMON_RESAMPLER_H
+#define COMMON_RESAMPLER_H
+
+#include <libavutil/frame.h>
+#include <libavutil/samplefmt.h>
+#include <libswresample/swresample.h>
+
+// 重采样缓存: 以(输入声道布局, 采样率, 采样格式) -> 输出格式为key,
+// SwrContext 只创建一次并跨帧复用, 仅当输入格式变化时才重建.
+// 这样既省掉了每帧 swr_alloc/swr_init 的开销, 也保留了重采样器内部的滤波历史.
+typedef struct AudioResampler {
+    SwrContext* swr_ctx;
+    // 输入格式(key)
+    int64_t in_channel_layout;
+    int in_sample_rate;
+    enum AVSampleFormat in_sample_fmt;
+    // 输出格式
+    int64_t out_channel_layout;
+    int out_nb_channels;
+    int out_sample_rate;
+    enum AVSampleFormat out_sample_fmt;
+    // 只增不减的输出缓冲区, 由 av_fast_malloc 管理
+    uint8_t* out_buf;
+    unsigned int out_buf_size;
+    // 统计: SwrContext 被(重新)创建的次数
+    int nb_rebuilds;
+} AudioResampler;
+
+void audio_resampler_init(AudioResampler* r);
+// 转换一帧音频, 成功返回输出字节数, *out 指向内部缓冲区(下一次调用前有效)
+int audio_resampler_convert(AudioResampler* r, const AVFrame* frame,
+                            enum AVSampleFormat out_sample_fmt,
+                            int out_channels, int out_sample_rate,
+                            uint8_t** out);
+void audio_resampler_free(AudioResampler* r);
+
+#endif
@@ -0,0 +1,416 @@
+#include "slice_scaler.h"
+
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/mathematics.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <stdio.h>
+#include <string.h>
+
+// 第p个平面相对亮度平面的垂直下采样位数
+static int plane_shift(enum AVPixelFormat pix_fmt, int p) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(pix_fmt);
+    return (p == 1 || p == 2) ? desc->log2_chroma_h : 0;
+}
+
+static void scale_band(SliceScaler* s, SliceScalerBand* band) {
+    if (!band->sws_ctx) {
+        return;
+    }
+    const uint8_t* src[4] = { NULL };
+    uint8_t* dst[4] = { NULL };
+    for (int p = 0; p < 4; p++) {
+        if (s->src[p]) {
+            src[p] = s->src[p] + (ptrdiff_t)(band->src_y >> plane_shift(s->src_fmt, p)) * s->src_stride[p];
+        }
+        if (s->dst[p]) {
+            dst[p] = s->dst[p] + (ptrdiff_t)(band->crop_y >> plane_shift(s->dst_fmt, p)) * s->dst_stride[p];
+        }
+    }
+    if (!band->scratch[0]) {
+        sws_scale(band->sws_ctx, src, s->src_stride, 0, band->src_h, dst, s->dst_stride);
+        return;
+    }
+    // 带重叠: 整段输出到临时缓冲区, 只把本带负责的行拷到目标帧
+    sws_scale(band->sws_ctx, src, s->src_stride, 0, band->src_h, band->scratch, band->scratch_stride);
+    for (int p = 0; p < 4 && band->scratch[p]; p++) {
+        int shift = plane_shift(s->dst_fmt, p);
+        int y = band->out_y >> shift;
+        int h = AV_CEIL_RSHIFT(band->out_y + band->out_h, shift) - y;
+        int offset = (band->out_y - band->crop_y) >> shift;
+        av_image_copy_plane(s->dst[p] + (ptrdiff_t)y * s->dst_stride[p], s->dst_stride[p],
+            band->scratch[p] + (ptrdiff_t)offset * band->scratch_stride[p], band->scratch_stride[p],
+            av_image_get_linesize(s->dst_fmt, s->dst_w, p), h);
+    }
+}
+
+static int slice_scaler_thread(void* arg) {
+    SliceScalerBand* band = (SliceScalerBand*)arg;
+    SliceScaler* s = band->scaler;
+    int seen = 0;
+    SDL_LockMutex(s->mutex);
+    for (;;) {
+        while (!s->quit && s->generation == seen) {
+            SDL_CondWait(s->work_cond, s->mutex);
+        }
+        if (s->quit) {
+            break;
+        }
+        seen = s->generation;
+        SDL_UnlockMutex(s->mutex);
+        if (band->index < s->nb_bands) {
+            scale_band(s, band);
+        }
+        SDL_LockMutex(s->mutex);
+        if (--s->pending == 0) {
+            SDL_CondSignal(s->done_cond);
+        }
+    }
+    SDL_UnlockMutex(s->mutex);
+    return 0;
+}
+
+int slice_scaler_init(SliceScaler* s, int nb_threads) {
+    memset(s, 0, sizeof(SliceScaler));
+    s->nb_threads = av_clip(nb_threads, 1, SLICE_SCALER_MAX_THREADS);
+    s->src_fmt = AV_PIX_FMT_NONE;
+    s->dst_fmt = AV_PIX_FMT_NONE;
+    s->mutex = SDL_CreateMutex();
+    s->work_cond = SDL_CreateCond();
+    s->done_cond = SDL_CreateCond();
+    if (!s->mutex || !s->work_cond || !s->done_cond) {
+        printf("SliceScaler: SDL_CreateMutex/SDL_CreateCond error\n");
+        return -1;
+    }
+    for (int i = 0; i < s->nb_threads; i++) {
+        s->bands[i].scaler = s;
+        s->bands[i].index = i;
+    }
+    // 第0带由调用线程处理
+    for (int i = 1; i < s->nb_threads; i++) {
+        s->bands[i].thread = SDL_CreateThread(slice_scaler_thread, "slice_scaler", &s->bands[i]);
+        if (!s->bands[i].thread) {
+            printf("SliceScaler: Could not create thread - %s\n", SDL_GetError());
+            s->nb_threads = i;
+            break;
+        }
+    }
+    return 0;
+}
+
+static void free_bands(SliceScaler* s) {
+    for (int i = 0; i < SLICE_SCALER_MAX_THREADS; i++) {
+        SliceScalerBand* band = &s->bands[i];
+        sws_freeContext(band->sws_ctx);
+        band->sws_ctx = NULL;
+        av_freep(&band->scratch[0]);
+        memset(band->scratch, 0, sizeof(band->scratch));
+    }
+    s->nb_bands = 0;
+    s->overlap = 0;
+}
+
+void slice_scaler_free(SliceScaler* s) {
+    if (s->mutex) {
+        SDL_LockMutex(s->mutex);
+        s->quit = 1;
+        SDL_CondBroadcast(s->work_cond);
+        SDL_UnlockMutex(s->mutex);
+    }
+    for (int i = 1; i < SLICE_SCALER_MAX_THREADS; i++) {
+        if (s->bands[i].thread) {
+            SDL_WaitThread(s->bands[i].thread, NULL);
+            s->bands[i].thread = NULL;
+        }
+    }
+    free_bands(s);
+    if (s->done_cond) {
+        SDL_DestroyCond(s->done_cond);
+        s->done_cond = NULL;
+    }
+    if (s->work_cond) {
+        SDL_DestroyCond(s->work_cond);
+        s->work_cond = NULL;
+    }
+    if (s->mutex) {
+        SDL_DestroyMutex(s->mutex);
+        s->mutex = NULL;
+    }
+}
+
+static int create_band_context(SliceScaler* s, SliceScalerBand* band) {
+    band->sws_ctx = sws_getContext(s->src_w, band->src_h, s->src_fmt,
+        s->dst_w, band->crop_h, s->dst_fmt, s->flags, NULL, NULL, NULL);
+    if (!band->sws_ctx) {
+        printf("SliceScaler: sws_getContext error\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int setup_single(SliceScaler* s) {
+    free_bands(s);
+    SliceScalerBand* band = &s->bands[0];
+    band->src_y = 0;
+    band->src_h = s->src_h;
+    band->crop_y = band->out_y = 0;
+    band->crop_h = band->out_h = s->dst_h;
+    if (create_band_context(s, band) < 0) {
+        return -1;
+    }
+    s->nb_bands = 1;
+    return 0;
+}
+
+// 切成最多 nb_bands 个带; 返回实际的带数(不足2个时不切), -1出错.
+// 边界按"步长"取: 一步是源/目标行数之比保持不变的最小行数, 且两边都是 SLICE_SCALER_ALIGN 的倍数.
+static int setup_bands(SliceScaler* s, int nb_bands, int overlap) {
+    free_bands(s);
+    int64_t g = av_gcd(s->src_h, s->dst_h);
+    int src_unit = s->src_h / g;
+    int dst_unit = s->dst_h / g;
+    int k = SLICE_SCALER_ALIGN / av_gcd(src_unit, SLICE_SCALER_ALIGN);
+    int k_dst = SLICE_SCALER_ALIGN / av_gcd(dst_unit, SLICE_SCALER_ALIGN);
+    k = k / av_gcd(k, k_dst) * k_dst;
+    int64_t src_step = (int64_t)k * src_unit;
+    int64_t dst_step = (int64_t)k * dst_unit;
+    int nb_steps = s->src_h / src_step;
+    if (nb_steps < 2) {
+        return 0;
+    }
+    nb_bands = FFMIN(nb_bands, nb_steps);
+    int per_band = (nb_steps + nb_bands - 1) / nb_bands;
+    int n = 0;
+    for (int first = 0; first < nb_steps; first += per_band, n++) {
+        int last = FFMIN(first + per_band, nb_steps);
+        SliceScalerBand* band = &s->bands[n];
+        // 最后一带包含不足一步的尾部
+        int src_end = last == nb_steps ? s->src_h : last * src_step;
+        int dst_end = last == nb_steps ? s->dst_h : last * dst_step;
+        band->out_y = first * dst_step;
+        band->out_h = dst_end - band->out_y;
+        band->src_y = first * src_step;
+        band->crop_y = band->out_y;
+        if (overlap) {
+            // 上下各多看一步, 超出帧的部分截掉
+            if (first > 0) {
+                band->src_y -= src_step;
+                band->crop_y -= dst_step;
+            }
+            if (last + 1 >= nb_steps) {
+                src_end = s->src_h;
+                dst_end = s->dst_h;
+            } else {
+                src_end = (last + 1) * src_step;
+                dst_end = (last + 1) * dst_step;
+            }
+        }
+        band->src_h = src_end - band->src_y;
+        band->crop_h = dst_end - band->crop_y;
+        if (create_band_context(s, band) < 0) {
+            free_bands(s);
+            return -1;
+        }
+        if (overlap && av_image_alloc(band->scratch, band->scratch_stride,
+                s->dst_w, band->crop_h, s->dst_fmt, 32) < 0) {
+            printf("SliceScaler: av_image_alloc error\n");
+            free_bands(s);
+            return -1;
+        }
+    }
+    s->nb_bands = n;
+    s->overlap = overlap;
+    return n;
+}
+
+static void fill_noise(uint8_t* buf, int size) {
+    uint32_t seed = 0x12345678;
+    for (int i = 0; i < size; i++) {
+        seed = seed * 1664525 + 1013904223;
+        buf[i] = seed >> 24;
+    }
+}
+
+static void get_layout(SliceScalerLayout* layout, const uint8_t* const src[], const int src_stride[],
+                       uint8_t* const dst[], const int dst_stride[]) {
+    for (int p = 0; p < 4; p++) {
+        layout->src_stride[p] = src[p] ? src_stride[p] : 0;
+        layout->src_align[p] = src[p] ? (int)((uintptr_t)src[p] & (SLICE_SCALER_LAYOUT_ALIGN - 1)) : -1;
+        layout->dst_stride[p] = dst[p] ? dst_stride[p] : 0;
+        layout->dst_align[p] = dst[p] ? (int)((uintptr_t)dst[p] & (SLICE_SCALER_LAYOUT_ALIGN - 1)) : -1;
+    }
+}
+
+// 负的 stride(上下翻转)时带的行偏移方向相反, 不切
+static int layout_can_split(const SliceScalerLayout* layout) {
+    for (int p = 0; p < 4; p++) {
+        if ((layout->src_align[p] >= 0 && layout->src_stride[p] <= 0) ||
+            (layout->dst_align[p] >= 0 && layout->dst_stride[p] <= 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// 按布局分配一帧: 每个平面单独分配, stride 和地址的对齐与调用者相同; bufs 是要释放的指针
+static int alloc_like(uint8_t* bufs[4], uint8_t* data[4], enum AVPixelFormat pix_fmt, int h,
+                      const int stride[4], const int align[4]) {
+    for (int p = 0; p < 4; p++) {
+        bufs[p] = data[p] = NULL;
+        if (align[p] < 0) {
+            continue;
+        }
+        size_t size = (size_t)stride[p] * AV_CEIL_RSHIFT(h, plane_shift(pix_fmt, p));
+        bufs[p] = av_malloc(size + 2 * SLICE_SCALER_LAYOUT_ALIGN);
+        if (!bufs[p]) {
+            return -1;
+        }
+        data[p] = (uint8_t*)FFALIGN((uintptr_t)bufs[p], SLICE_SCALER_LAYOUT_ALIGN) + align[p];
+        fill_noise(data[p], (int)size);
+    }
+    return 0;
+}
+
+static void free_like(uint8_t* bufs[4]) {
+    for (int p = 0; p < 4; p++) {
+        av_freep(&bufs[p]);
+    }
+}
+
+static void run_bands(SliceScaler* s, const uint8_t* const src[], const int src_stride[],
+                      uint8_t* const dst[], const int dst_stride[]) {
+    s->src = src;
+    s->src_stride = src_stride;
+    s->dst = dst;
+    s->dst_stride = dst_stride;
+    if (s->nb_bands <= 1) {
+        scale_band(s, &s->bands[0]);
+        return;
+    }
+    SDL_LockMutex(s->mutex);
+    s->pending = s->nb_threads - 1;
+    s->generation++;
+    SDL_CondBroadcast(s->work_cond);
+    SDL_UnlockMutex(s->mutex);
+
+    scale_band(s, &s->bands[0]);
+
+    SDL_LockMutex(s->mutex);
+    while (s->pending > 0) {
+        SDL_CondWait(s->done_cond, s->mutex);
+    }
+    SDL_UnlockMutex(s->mutex);
+}
+
+// 用 s->layout 布局的随机数据比较分带结果和整帧结果; 返回1一致, 0不一致, -1出错
+static int check_bit_exact(SliceScaler* s) {
+    const SliceScalerLayout* layout = &s->layout;
+    uint8_t* src_bufs[4] = { NULL };
+    uint8_t* bands_bufs[4] = { NULL };
+    uint8_t* full_bufs[4] = { NULL };
+    uint8_t* src[4];
+    uint8_t* dst_bands[4];
+    uint8_t* dst_full[4];
+    struct SwsContext* full = NULL;
+    int ret = -1;
+    if (alloc_like(src_bufs, src, s->src_fmt, s->src_h, layout->src_stride, layout->src_align) < 0 ||
+        alloc_like(bands_bufs, dst_bands, s->dst_fmt, s->dst_h, layout->dst_stride, layout->dst_align) < 0 ||
+        alloc_like(full_bufs, dst_full, s->dst_fmt, s->dst_h, layout->dst_stride, layout->dst_align) < 0) {
+        goto end;
+    }
+    full = sws_getContext(s->src_w, s->src_h, s->src_fmt, s->dst_w, s->dst_h, s->dst_fmt,
+        s->flags, NULL, NULL, NULL);
+    if (!full) {
+        goto end;
+    }
+    run_bands(s, (const uint8_t* const*)src, layout->src_stride, dst_bands, layout->dst_stride);
+    sws_scale(full, (const uint8_t* const*)src, layout->src_stride, 0, s->src_h, dst_full, layout->dst_stride);
+    ret = 1;
+    for (int p = 0; p < 4 && dst_full[p] && ret; p++) {
+        int bytes = av_image_get_linesize(s->dst_fmt, s->dst_w, p);
+        int rows = AV_CEIL_RSHIFT(s->dst_h, plane_shift(s->dst_fmt, p));
+        for (int y = 0; y < rows; y++) {
+            if (memcmp(dst_bands[p] + (ptrdiff_t)y * layout->dst_stride[p],
+                    dst_full[p] + (ptrdiff_t)y * layout->dst_stride[p], bytes)) {
+                ret = 0;
+                break;
+            }
+        }
+    }
+end:
+    sws_freeContext(full);
+    free_like(src_bufs);
+    free_like(bands_bufs);
+    free_like(full_bufs);
+    return ret;
+}
+
+// 按 layout 重新选择切法, 都不一致时退回单个上下文
+static int select_bands(SliceScaler* s, const SliceScalerLayout* layout) {
+    s->layout = *layout;
+    s->layout_checked = 1;
+    // 调色板格式 data[1] 不是按行存放的平面, 不能按行偏移
+    int can_split = s->nb_threads > 1 && layout_can_split(layout) &&
+        !(av_pix_fmt_desc_get(s->src_fmt)->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL)) &&
+        !(av_pix_fmt_desc_get(s->dst_fmt)->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL));
+    for (int overlap = 0; can_split && overlap <= 1; overlap++) {
+        int nb_bands = setup_bands(s, s->nb_threads, overlap);
+        if (nb_bands < 0) {
+            break;
+        }
+        if (nb_bands < 2) {
+            break;
+        }
+        int exact = check_bit_exact(s);
+        if (exact > 0) {
+            return 0;
+        } else if (exact < 0) {
+            break;
+        }
+        if (overlap) {
+            printf("SliceScaler: %s %dx%d -> %s %dx%d is not slice-exact, using a single context\n",
+                av_get_pix_fmt_name(s->src_fmt), s->src_w, s->src_h, av_get_pix_fmt_name(s->dst_fmt),
+                s->dst_w, s->dst_h);
+        }
+    }
+    if (s->nb_bands == 1) {
+        return 0;
+    }
+    return setup_single(s);
+}
+
+int slice_scaler_configure(SliceScaler* s, int src_w, int src_h, enum AVPixelFormat src_fmt,
+                           int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags) {
+    if (s->nb_bands > 0 && src_w == s->src_w && src_h == s->src_h && src_fmt == s->src_fmt &&
+        dst_w == s->dst_w && dst_h == s->dst_h && dst_fmt == s->dst_fmt && flags == s->flags) {
+        return 0;
+    }
+    s->src_w = src_w;
+    s->src_h = src_h;
+    s->src_fmt = src_fmt;
+    s->dst_w = dst_w;
+    s->dst_h = dst_h;
+    s->dst_fmt = dst_fmt;
+    s->flags = flags;
+    // 切法要等第一次 scale 看到调用者的内存布局再选, 先用单个上下文, 同时检查参数是否可用
+    s->layout_checked = 0;
+    return setup_single(s);
+}
+
+int slice_scaler_scale(SliceScaler* s, const uint8_t* const src[], const int src_stride[],
+                       uint8_t* const dst[], const int dst_stride[]) {
+    SliceScalerLayout layout;
+    get_layout(&layout, src, src_stride, dst, dst_stride);
+    if (s->nb_bands > 0 && (!s->layout_checked || memcmp(&layout, &s->layout, sizeof(layout)) != 0)) {
+        if (select_bands(s, &layout) < 0) {
+            return -1;
+        }
+    }
+    if (s->nb_bands == 0) {
+        printf("SliceScaler: no usable SwsContext\n");
+        return -1;
+    }
+    run_bands(s, src, src_stride, dst, dst_stride);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef COMMON_SLICE_SCALER_H
+#define COMMON_SLICE_SCALER_H
+
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_thread.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+
+#define SLICE_SCALER_MAX_THREADS 16
+// 分带边界的行对齐(源和目标都要满足): 覆盖色度垂直下采样和抖动表的周期
+#define SLICE_SCALER_ALIGN 16
+// 检查时按调用者平面地址对这个值取模的余数复现对齐, 覆盖 swscale 选择 SIMD 路径时看的对齐
+#define SLICE_SCALER_LAYOUT_ALIGN 64
+
+// 分带并行的 sws_scale: 把帧按行切成若干水平带, 每个带有自己的 SwsContext, 由线程池并行转换,
+// 调用线程自己处理第0带. 带的边界取在源/目标行数之比为整数的位置, 所以每个带是整帧转换的一个平移.
+// swscale 按 stride 和地址对齐选择 SIMD 或C路径, 所以切法按调用者实际的内存布局选:
+// 每遇到一种新的布局(各平面的 stride 和地址对齐), 用同样布局的随机数据和整帧单上下文的结果
+// 逐字节比较, 按以下顺序选第一个一致的:
+//  1. 直接切: 带的上下文只看自己的源行, 输出直接写到目标帧(逐行独立的转换, 如 yuv420p -> rgb24);
+//  2. 带重叠: 带的上下文多看上下各一段源行, 输出到自己的临时缓冲区, 再把中间部分拷到目标帧
+//     (垂直方向有滤波的转换, 如色度插值或缩放);
+//  3. 都不一致时退回单个上下文.
+// 因此输出总是与单线程 sws_scale 逐位相同.
+typedef struct SliceScaler SliceScaler;
+
+// 一帧源/目标的内存布局: 各平面的 stride 和地址对 SLICE_SCALER_LAYOUT_ALIGN 的余数, 没有的平面为 -1
+typedef struct SliceScalerLayout {
+    int src_stride[4];
+    int src_align[4];
+    int dst_stride[4];
+    int dst_align[4];
+} SliceScalerLayout;
+
+typedef struct SliceScalerBand {
+    SliceScaler* scaler;
+    int index;
+    struct SwsContext* sws_ctx;
+    // 本带上下文处理的源行 / 输出行范围
+    int src_y;
+    int src_h;
+    int crop_y;
+    int crop_h;
+    // 本带负责写入目标帧的行范围
+    int out_y;
+    int out_h;
+    // 带重叠时的临时输出缓冲区
+    uint8_t* scratch[4];
+    int scratch_stride[4];
+    SDL_Thread* thread;
+} SliceScalerBand;
+
+struct SliceScaler {
+    int nb_threads;
+    int nb_bands;
+    // 0直接切, 1带重叠
+    int overlap;
+    SliceScalerBand bands[SLICE_SCALER_MAX_THREADS];
+    // 当前配置(key)
+    int src_w;
+    int src_h;
+    enum AVPixelFormat src_fmt;
+    int dst_w;
+    int dst_h;
+    enum AVPixelFormat dst_fmt;
+    int flags;
+    // 当前的切法是按哪种布局检查过的
+    SliceScalerLayout layout;
+    int layout_checked;
+    // 当前任务, 由 slice_scaler_scale 发布给线程池
+    const uint8_t* const* src;
+    const int* src_stride;
+    uint8_t* const* dst;
+    const int* dst_stride;
+    int generation;
+    int pending;
+    int quit;
+    SDL_mutex* mutex;
+    SDL_cond* work_cond;
+    SDL_cond* done_cond;
+};
+
+// 创建 nb_threads-1 个工作线程(nb_threads<=1 时不创建线程)
+int slice_scaler_init(SliceScaler* s, int nb_threads);
+// 类似 sws_getCachedContext: 参数变化时才重建各带的 SwsContext; 返回0成功, -1失败
+int slice_scaler_configure(SliceScaler* s, int src_w, int src_h, enum AVPixelFormat src_fmt,
+                           int dst_w, int dst_h, enum AVPixelFormat dst_fmt, int flags);
+// 转换整帧, 语义同 sws_scale(ctx, src, src_stride, 0, src_h, dst, dst_stride);
+// 布局和上次不同时先重新检查选择切法. 返回0成功, -1失败(没有可用的 SwsContext)
+int slice_scaler_scale(SliceScaler* s, const uint8_t* const src[], const int src_stride[],
+                       uint8_t* const dst[], const int dst_stride[]);
+void slice_scaler_free(SliceScaler* s);
+
+#endif
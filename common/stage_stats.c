@@ -0,0 +1,27 @@
+#include "stage_stats.h"
+
+#include <libavutil/time.h>
+#include <stdio.h>
+
+void stage_stats_init(StageStats* s, const char* name) {
+    s->name = name;
+    atomic_init(&s->count, 0);
+    atomic_init(&s->busy_us, 0);
+    s->start_us = av_gettime_relative();
+}
+
+void stage_stats_add(StageStats* s, int64_t count, int64_t busy_us) {
+    atomic_fetch_add_explicit(&s->count, count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->busy_us, busy_us, memory_order_relaxed);
+}
+
+void stage_stats_print(StageStats* s) {
+    int64_t count = atomic_load(&s->count);
+    int64_t busy_us = atomic_load(&s->busy_us);
+    int64_t wall_us = av_gettime_relative() - s->start_us;
+    printf("%-12s %8lld items  %9.1f/s wall  %9.1f/s busy  %7.3f ms/item\n",
+        s->name, (long long)count,
+        wall_us > 0 ? count * 1e6 / wall_us : 0.0,
+        busy_us > 0 ? count * 1e6 / busy_us : 0.0,
+        count > 0 ? busy_us / 1000.0 / count : 0.0);
+}
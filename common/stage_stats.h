@@ -0,0 +1,22 @@
+#ifndef COMMON_STAGE_STATS_H
+#define COMMON_STAGE_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// 流水线单个阶段(demux/decode/render...)的吞吐统计, 可跨线程累加.
+// busy_us 只统计真正干活的时间, 不含在队列上阻塞等待的时间,
+// 所以 count/busy 反映的是该阶段单独能跑到的速度.
+typedef struct StageStats {
+    const char* name;
+    atomic_llong count;
+    atomic_llong busy_us;
+    int64_t start_us;
+} StageStats;
+
+void stage_stats_init(StageStats* s, const char* name);
+void stage_stats_add(StageStats* s, int64_t count, int64_t busy_us);
+// 打印: 总数, 按墙钟时间的速率, 按忙碌时间的速率, 平均单次耗时
+void stage_stats_print(StageStats* s);
+
+#endif
@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stream_writer.h"
+
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+// y4m 能直接表示的像素格式, 其它格式转成 yuv420p
+static const char* y4m_colorspace(enum AVPixelFormat pix_fmt) {
+    switch (pix_fmt) {
+    case AV_PIX_FMT_YUV420P:
+    case AV_PIX_FMT_YUVJ420P:
+        return "420jpeg";
+    case AV_PIX_FMT_YUV422P:
+        return "422";
+    case AV_PIX_FMT_YUV444P:
+        return "444";
+    case AV_PIX_FMT_GRAY8:
+        return "mono";
+    default:
+        return NULL;
+    }
+}
+
+int stream_writer_open(StreamWriter* w, const char* path, StreamFormat format, AVRational frame_rate) {
+    memset(w, 0, sizeof(*w));
+    w->format = format;
+    w->frame_rate = frame_rate;
+    if (strcmp(path, "-") == 0) {
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        if (fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            printf("Could not redirect stdout\n");
+            return -1;
+        }
+        w->out = fdopen(fd, "wb");
+    } else {
+        // FIFO 在这里阻塞到读端打开
+        w->out = fopen(path, "wb");
+    }
+    if (!w->out) {
+        printf("Could not open output %s\n", path);
+        return -1;
+    }
+    setvbuf(w->out, NULL, _IOFBF, STREAM_WRITER_BUFFER_SIZE);
+    // 下游提前退出时让 fwrite 返回错误, 而不是整个进程被 SIGPIPE 杀掉
+    signal(SIGPIPE, SIG_IGN);
+    w->converted = av_frame_alloc();
+    if (!w->converted || slice_scaler_init(&w->scaler, 1) < 0) {
+        printf("stream_writer_open failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int configure(StreamWriter* w, const AVFrame* frame) {
+    w->width = frame->width;
+    w->height = frame->height;
+    w->pix_fmt = frame->format;
+    if (w->format == STREAM_Y4M) {
+        if (!y4m_colorspace(w->pix_fmt)) {
+            w->pix_fmt = AV_PIX_FMT_YUV420P;
+        }
+        AVRational sar = frame->sample_aspect_ratio;
+        int full_range = w->pix_fmt == AV_PIX_FMT_YUVJ420P || frame->color_range == AVCOL_RANGE_JPEG;
+        fprintf(w->out, "YUV4MPEG2 W%d H%d F%d:%d Ip A%d:%d C%s%s\n", w->width, w->height,
+            w->frame_rate.num, w->frame_rate.den, sar.num, sar.den,
+            y4m_colorspace(w->pix_fmt), full_range ? " XCOLORRANGE=FULL" : "");
+    }
+    printf("streaming %s %dx%d %s %d/%d fps\n", w->format == STREAM_Y4M ? "y4m" : "rawvideo",
+        w->width, w->height, av_get_pix_fmt_name(w->pix_fmt), w->frame_rate.num, w->frame_rate.den);
+    w->configured = 1;
+    return 0;
+}
+
+// 每个平面行宽等于 linesize 时整块写, 否则逐行写进 stdio 缓冲区(只是 memcpy)
+static int write_planes(StreamWriter* w, const AVFrame* frame) {
+    const AVPixFmtDescriptor* desc = av_pix_fmt_desc_get(frame->format);
+    int nb_planes = av_pix_fmt_count_planes(frame->format);
+    for (int p = 0; p < nb_planes; p++) {
+        int bytes = av_image_get_linesize(frame->format, frame->width, p);
+        int rows = (p == 1 || p == 2) ? AV_CEIL_RSHIFT(frame->height, desc->log2_chroma_h) : frame->height;
+        if (frame->linesize[p] == bytes) {
+            if (fwrite(frame->data[p], bytes, rows, w->out) != (size_t)rows) {
+                return -1;
+            }
+        } else {
+            for (int y = 0; y < rows; y++) {
+                if (fwrite(frame->data[p] + y * frame->linesize[p], 1, bytes, w->out) != (size_t)bytes) {
+                    return -1;
+                }
+            }
+        }
+        w->bytes += (int64_t)bytes * rows;
+    }
+    return 0;
+}
+
+int stream_writer_write(StreamWriter* w, const AVFrame* frame) {
+    if (w->error) {
+        return -1;
+    }
+    if (!w->configured) {
+        configure(w, frame);
+    }
+    const AVFrame* out = frame;
+    if (frame->width != w->width || frame->height != w->height || frame->format != w->pix_fmt) {
+        if (slice_scaler_configure(&w->scaler, frame->width, frame->height, frame->format,
+                w->width, w->height, w->pix_fmt, SWS_BILINEAR) < 0) {
+            printf("slice_scaler_configure failed\n");
+            return -1;
+        }
+        if (!w->converted->data[0]) {
+            w->converted->format = w->pix_fmt;
+            w->converted->width = w->width;
+            w->converted->height = w->height;
+            if (av_frame_get_buffer(w->converted, 32) < 0) {
+                printf("av_frame_get_buffer failed\n");
+                return -1;
+            }
+        }
+        if (slice_scaler_scale(&w->scaler, (const uint8_t* const*)frame->data, frame->linesize,
+                w->converted->data, w->converted->linesize) < 0) {
+            printf("slice_scaler_scale failed\n");
+            return -1;
+        }
+        out = w->converted;
+    }
+    if ((w->format == STREAM_Y4M && fputs("FRAME\n", w->out) == EOF) || write_planes(w, out) < 0) {
+        printf("write to output failed, stop streaming\n");
+        w->error = 1;
+        return -1;
+    }
+    w->nb_frames++;
+    return 0;
+}
+
+void stream_writer_close(StreamWriter* w) {
+    if (w->out) {
+        fclose(w->out);
+        w->out = NULL;
+        printf("streamed %lld frames, %.1f MB\n", (long long)w->nb_frames, w->bytes / (1024.0 * 1024.0));
+    }
+    slice_scaler_free(&w->scaler);
+    av_frame_free(&w->converted);
+}
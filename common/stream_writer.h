@@ -0,0 +1,45 @@
+#ifndef COMMON_STREAM_WRITER_H
+#define COMMON_STREAM_WRITER_H
+
+#include <libavutil/frame.h>
+#include <libavutil/rational.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "slice_scaler.h"
+
+// stdio 缓冲区大小: 一帧 1080p yuv420p 约3MB, 攒够几MB才真正 write 一次
+#define STREAM_WRITER_BUFFER_SIZE (4 << 20)
+
+typedef enum StreamFormat {
+    STREAM_Y4M, // YUV4MPEG2, 可以直接喂给 ffmpeg -i - / x264 --demuxer y4m 等
+    STREAM_RAW, // 只有各平面的原始数据, 下游需要另外指定尺寸和像素格式
+} StreamFormat;
+
+// 把解码帧按顺序写成一个连续的视频流(stdout 或 FIFO/文件), 不再每帧建一个文件.
+// 流的尺寸和像素格式由第一帧决定(y4m 不支持的格式转成 yuv420p), 之后的帧不一致时用 swscale 转换.
+typedef struct StreamWriter {
+    FILE* out;
+    StreamFormat format;
+    AVRational frame_rate;
+    // 流参数, 第一帧到达时确定
+    int configured;
+    int width;
+    int height;
+    enum AVPixelFormat pix_fmt;
+    SliceScaler scaler;
+    AVFrame* converted;
+    // 写失败(如下游关闭了管道)后不再写
+    int error;
+    int64_t nb_frames;
+    int64_t bytes;
+} StreamWriter;
+
+// path 为 "-" 时写到 stdout, 同时把进程的 stdout 改指向 stderr, 避免 printf 日志混进视频流;
+// 返回0成功, -1失败
+int stream_writer_open(StreamWriter* w, const char* path, StreamFormat format, AVRational frame_rate);
+// 返回0成功, -1失败
+int stream_writer_write(StreamWriter* w, const AVFrame* frame);
+void stream_writer_close(StreamWriter* w);
+
+#endif
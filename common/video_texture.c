@@ -0,0 +1,242 @@
+#include "video_texture.h"
+
+#include <libavutil/common.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
+#include <stdio.h>
+#include <string.h>
+
+// 可以直接上传的解码器输出格式和对应的SDL纹理格式
+static const struct {
+    enum AVPixelFormat pix_fmt;
+    Uint32 sdl_format;
+} texture_format_map[] = {
+    { AV_PIX_FMT_YUV420P, SDL_PIXELFORMAT_IYUV },
+    { AV_PIX_FMT_NV12,    SDL_PIXELFORMAT_NV12 },
+    { AV_PIX_FMT_NV21,    SDL_PIXELFORMAT_NV21 },
+};
+
+static Uint32 direct_texture_format(enum AVPixelFormat pix_fmt) {
+#if !SDL_VERSION_ATLEAST(2, 0, 16)
+    // 旧版本SDL没有 SDL_UpdateNVTexture, NV12/NV21 只能走swscale
+    if (pix_fmt != AV_PIX_FMT_YUV420P) {
+        return SDL_PIXELFORMAT_UNKNOWN;
+    }
+#endif
+    for (size_t i = 0; i < sizeof(texture_format_map) / sizeof(texture_format_map[0]); i++) {
+        if (texture_format_map[i].pix_fmt == pix_fmt) {
+            return texture_format_map[i].sdl_format;
+        }
+    }
+    return SDL_PIXELFORMAT_UNKNOWN;
+}
+
+void video_texture_init(VideoTexture* vt, SDL_Renderer* renderer) {
+    memset(vt, 0, sizeof(VideoTexture));
+    vt->renderer = renderer;
+    vt->mode = VIDEO_TEXTURE_LOCK;
+    vt->pix_fmt = AV_PIX_FMT_NONE;
+    vt->start_us = av_gettime_relative();
+    slice_scaler_init(&vt->scaler, 1);
+}
+
+void video_texture_free(VideoTexture* vt) {
+    if (vt->texture) {
+        SDL_DestroyTexture(vt->texture);
+        vt->texture = NULL;
+    }
+    av_freep(&vt->null_pixels);
+    slice_scaler_free(&vt->scaler);
+    av_frame_free(&vt->tmp);
+}
+
+void video_texture_set_size(VideoTexture* vt, int width, int height) {
+    if (width != vt->target_width || height != vt->target_height) {
+        vt->target_width = width;
+        vt->target_height = height;
+        vt->need_configure = 1;
+    }
+}
+
+void video_texture_set_threads(VideoTexture* vt, int nb_threads) {
+    if (nb_threads != vt->scaler.nb_threads) {
+        // 重建线程池, 下一帧上传时重新配置
+        slice_scaler_free(&vt->scaler);
+        slice_scaler_init(&vt->scaler, nb_threads);
+    }
+}
+
+void video_texture_set_mode(VideoTexture* vt, enum VideoTextureMode mode) {
+    if (mode != vt->mode) {
+        vt->mode = mode;
+        vt->need_configure = 1;
+    }
+}
+
+// 帧格式/尺寸或显示尺寸变化时重建纹理(经过swscale时还要准备中间帧)
+static int video_texture_configure(VideoTexture* vt, const AVFrame* frame) {
+    // 只缩小不放大: 显示尺寸比帧大时交给渲染器放大, 上传量不变
+    int out_width = frame->width;
+    int out_height = frame->height;
+    if (vt->target_width > 0 && vt->target_height > 0 &&
+        (vt->target_width < frame->width || vt->target_height < frame->height)) {
+        out_width = FFMIN(vt->target_width, frame->width) & ~1;
+        out_height = FFMIN(vt->target_height, frame->height) & ~1;
+        out_width = FFMAX(out_width, 2);
+        out_height = FFMAX(out_height, 2);
+    }
+    Uint32 sdl_format = direct_texture_format(frame->format);
+    vt->direct = sdl_format != SDL_PIXELFORMAT_UNKNOWN && out_width == frame->width && out_height == frame->height;
+    av_frame_free(&vt->tmp);
+    if (!vt->direct) {
+        sdl_format = SDL_PIXELFORMAT_IYUV;
+    }
+    if (!vt->direct && vt->mode == VIDEO_TEXTURE_UPDATE && vt->renderer) {
+        vt->tmp = av_frame_alloc();
+        if (!vt->tmp) {
+            printf("av_frame_alloc error\n");
+            return -1;
+        }
+        vt->tmp->format = AV_PIX_FMT_YUV420P;
+        vt->tmp->width = out_width;
+        vt->tmp->height = out_height;
+        if (av_frame_get_buffer(vt->tmp, 32) < 0) {
+            printf("av_frame_get_buffer error\n");
+            return -1;
+        }
+    }
+    if (!vt->renderer) {
+        // 空输出: 按纹理的布局分配内存, Y 平面之后跟色度平面, pitch 按32字节对齐
+        if (!vt->null_pixels || sdl_format != vt->sdl_format || out_width != vt->out_width || out_height != vt->out_height) {
+            av_freep(&vt->null_pixels);
+            vt->null_pitch = FFALIGN(out_width, 32);
+            vt->null_pixels = av_malloc((size_t)vt->null_pitch * out_height +
+                (size_t)((vt->null_pitch + 1) & ~1) * ((out_height + 1) / 2));
+            if (!vt->null_pixels) {
+                printf("av_malloc error\n");
+                return -1;
+            }
+        }
+    } else if (!vt->texture || sdl_format != vt->sdl_format || out_width != vt->out_width || out_height != vt->out_height) {
+        if (vt->texture) {
+            SDL_DestroyTexture(vt->texture);
+        }
+        vt->texture = SDL_CreateTexture(vt->renderer, sdl_format, SDL_TEXTUREACCESS_STREAMING, out_width, out_height);
+        if (!vt->texture) {
+            printf("SDL_CreateTexture error - %s\n", SDL_GetError());
+            return -1;
+        }
+    }
+    vt->sdl_format = sdl_format;
+    vt->pix_fmt = frame->format;
+    vt->width = frame->width;
+    vt->height = frame->height;
+    vt->out_width = out_width;
+    vt->out_height = out_height;
+    vt->need_configure = 0;
+    return 0;
+}
+
+// LOCK模式: 直接写进纹理内存.
+// IYUV 纹理是 Y, U, V 三个平面连续存放, 色度平面的 pitch 为 (pitch + 1) / 2;
+// NV12/NV21 纹理是 Y 平面之后跟交织的 UV 平面, pitch 与 Y 平面相同(向上取偶).
+static int video_texture_lock_upload(VideoTexture* vt, const AVFrame* frame) {
+    void* pixels = vt->null_pixels;
+    int pitch = vt->null_pitch;
+    if (vt->renderer && SDL_LockTexture(vt->texture, NULL, &pixels, &pitch) < 0) {
+        printf("SDL_LockTexture error - %s\n", SDL_GetError());
+        return -1;
+    }
+    uint8_t* dst[4] = { pixels, NULL, NULL, NULL };
+    int dst_linesize[4] = { pitch, 0, 0, 0 };
+    int chroma_w = (vt->out_width + 1) / 2;
+    int chroma_h = (vt->out_height + 1) / 2;
+    if (vt->sdl_format == SDL_PIXELFORMAT_IYUV) {
+        dst_linesize[1] = dst_linesize[2] = (pitch + 1) / 2;
+        dst[1] = dst[0] + pitch * vt->out_height;
+        dst[2] = dst[1] + dst_linesize[1] * chroma_h;
+    } else {
+        dst_linesize[1] = (pitch + 1) & ~1;
+        dst[1] = dst[0] + pitch * vt->out_height;
+    }
+    int ret = 0;
+    if (!vt->direct) {
+        ret = slice_scaler_scale(&vt->scaler, (const uint8_t* const*)frame->data, frame->linesize, dst, dst_linesize);
+    } else {
+        av_image_copy_plane(dst[0], dst_linesize[0], frame->data[0], frame->linesize[0], vt->out_width, vt->out_height);
+        if (vt->sdl_format == SDL_PIXELFORMAT_IYUV) {
+            av_image_copy_plane(dst[1], dst_linesize[1], frame->data[1], frame->linesize[1], chroma_w, chroma_h);
+            av_image_copy_plane(dst[2], dst_linesize[2], frame->data[2], frame->linesize[2], chroma_w, chroma_h);
+        } else {
+            av_image_copy_plane(dst[1], dst_linesize[1], frame->data[1], frame->linesize[1], chroma_w * 2, chroma_h);
+        }
+    }
+    if (vt->renderer) {
+        SDL_UnlockTexture(vt->texture);
+    }
+    return ret;
+}
+
+// UPDATE模式: 需要时先 sws_scale 到中间帧, 再由SDL拷进纹理
+static int video_texture_update_upload(VideoTexture* vt, const AVFrame* frame) {
+    const uint8_t* const* data = (const uint8_t* const*)frame->data;
+    const int* linesize = frame->linesize;
+    if (!vt->direct) {
+        if (slice_scaler_scale(&vt->scaler, data, linesize, vt->tmp->data, vt->tmp->linesize) < 0) {
+            return -1;
+        }
+        data = (const uint8_t* const*)vt->tmp->data;
+        linesize = vt->tmp->linesize;
+    }
+    int ret;
+    if (vt->sdl_format == SDL_PIXELFORMAT_IYUV) {
+        ret = SDL_UpdateYUVTexture(vt->texture, NULL,
+            data[0], linesize[0], data[1], linesize[1], data[2], linesize[2]);
+    } else {
+#if SDL_VERSION_ATLEAST(2, 0, 16)
+        ret = SDL_UpdateNVTexture(vt->texture, NULL, data[0], linesize[0], data[1], linesize[1]);
+#else
+        ret = -1;
+#endif
+    }
+    if (ret < 0) {
+        printf("texture update error - %s\n", SDL_GetError());
+        return -1;
+    }
+    return 0;
+}
+
+int video_texture_upload(VideoTexture* vt, const AVFrame* frame) {
+    if (vt->need_configure || frame->format != vt->pix_fmt || frame->width != vt->width || frame->height != vt->height) {
+        if (video_texture_configure(vt, frame) < 0) {
+            return -1;
+        }
+    }
+    if (!vt->direct) {
+        if (slice_scaler_configure(&vt->scaler, frame->width, frame->height, frame->format,
+                vt->out_width, vt->out_height, AV_PIX_FMT_YUV420P, SWS_BILINEAR) < 0) {
+            return -1;
+        }
+    }
+    int ret = vt->mode == VIDEO_TEXTURE_LOCK || !vt->renderer ? video_texture_lock_upload(vt, frame) : video_texture_update_upload(vt, frame);
+    if (ret < 0) {
+        return -1;
+    }
+    if (vt->direct) {
+        vt->nb_direct++;
+    } else {
+        vt->nb_converted++;
+    }
+    // IYUV/NV12/NV21 都是每像素1.5字节
+    vt->uploaded_bytes += av_image_get_buffer_size(AV_PIX_FMT_YUV420P, vt->out_width, vt->out_height, 1);
+    return 0;
+}
+
+void video_texture_print_stats(VideoTexture* vt) {
+    int64_t elapsed = av_gettime_relative() - vt->start_us;
+    printf("texture upload (%s): %lld frames direct, %lld through swscale, %dx%d texture, %.1f MB uploaded (%.1f MB/s)\n",
+        !vt->renderer ? "null" : vt->mode == VIDEO_TEXTURE_LOCK ? "lock" : "update",
+        (long long)vt->nb_direct, (long long)vt->nb_converted, vt->out_width, vt->out_height,
+        vt->uploaded_bytes / 1048576.0,
+        elapsed > 0 ? vt->uploaded_bytes / 1048576.0 * 1000000.0 / elapsed : 0.0);
+}
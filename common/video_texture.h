@@ -0,0 +1,66 @@
+#ifndef COMMON_VIDEO_TEXTURE_H
+#define COMMON_VIDEO_TEXTURE_H
+
+#include <SDL2/SDL.h>
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <libswscale/swscale.h>
+
+#include "slice_scaler.h"
+
+// 解码帧 -> SDL纹理的上传层.
+// 解码器输出 YUV420P/NV12/NV21 时, 创建对应格式(IYUV/NV12/NV21)的纹理, 直接上传 frame->data 的各个平面,
+// 省掉一次 sws_scale 到中间缓冲区的整帧拷贝; 其他格式才用 swscale 转成 YUV420P 再上传.
+// 设置了显示尺寸且比帧小时, 用 swscale 缩小到显示尺寸再上传, 不再把整帧交给渲染器去缩小.
+// 上传方式有两种: UPDATE 先写到自己的内存再由 SDL_Update*Texture 拷进纹理;
+// LOCK 用 SDL_LockTexture 拿到纹理内存, sws_scale 或平面拷贝直接写进去, 每帧少一次整帧拷贝.
+// 纹理按第一帧(以及之后帧格式/尺寸/显示尺寸变化时)的参数懒创建.
+// renderer 为 NULL 时是无界面的空输出: 用一块同样布局的内存代替纹理, 转换和拷贝照常做, 只是不显示.
+enum VideoTextureMode {
+    VIDEO_TEXTURE_UPDATE,
+    VIDEO_TEXTURE_LOCK,
+};
+
+typedef struct VideoTexture {
+    SDL_Renderer* renderer;
+    enum VideoTextureMode mode;
+    SDL_Texture* texture;
+    // 空输出时代替纹理的内存和它的 pitch
+    uint8_t* null_pixels;
+    int null_pitch;
+    Uint32 sdl_format;
+    // 当前纹理对应的源帧格式和尺寸
+    enum AVPixelFormat pix_fmt;
+    int width;
+    int height;
+    // 显示尺寸(0表示按帧尺寸), 以及纹理实际的尺寸
+    int target_width;
+    int target_height;
+    int out_width;
+    int out_height;
+    int need_configure;
+    // 1: 直接上传解码器输出的平面, 0: 先经过swscale
+    int direct;
+    // swscale 回退路径: 分带并行的缩放器和 YUV420P 中间帧(LOCK模式不需要中间帧)
+    SliceScaler scaler;
+    AVFrame* tmp;
+    // 统计: 直接上传 / 经过swscale 的帧数, 上传的字节数
+    int64_t nb_direct;
+    int64_t nb_converted;
+    int64_t uploaded_bytes;
+    int64_t start_us;
+} VideoTexture;
+
+// 默认 LOCK 模式; renderer 为 NULL 时为空输出, 总是按 LOCK 方式写进内存
+void video_texture_init(VideoTexture* vt, SDL_Renderer* renderer);
+void video_texture_set_mode(VideoTexture* vt, enum VideoTextureMode mode);
+// swscale 路径使用的线程数, 默认1
+void video_texture_set_threads(VideoTexture* vt, int nb_threads);
+// 设置显示尺寸(像素), 一般在创建窗口后和 SDL_WINDOWEVENT_SIZE_CHANGED 时调用
+void video_texture_set_size(VideoTexture* vt, int width, int height);
+// 把一帧上传到纹理, 返回0成功, -1失败
+int video_texture_upload(VideoTexture* vt, const AVFrame* frame);
+void video_texture_print_stats(VideoTexture* vt);
+void video_texture_free(VideoTexture* vt);
+
+#endif
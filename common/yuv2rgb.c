@@ -0,0 +1,231 @@
+#include "yuv2rgb.h"
+
+#include <libavutil/cpu.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define YUV2RGB_X86 1
+#include <immintrin.h>
+#else
+#define YUV2RGB_X86 0
+#endif
+
+static int16_t q13(double v) {
+    return (int16_t)lrint(v * 8192);
+}
+
+void yuv2rgb_coeffs_init(Yuv2RgbCoeffs* c, enum AVColorSpace colorspace, enum AVColorRange range) {
+    double kr = 0.299, kb = 0.114;
+    if (colorspace == AVCOL_SPC_BT709) {
+        kr = 0.2126;
+        kb = 0.0722;
+    }
+    double kg = 1 - kr - kb;
+    int full = range == AVCOL_RANGE_JPEG;
+    double y_scale = full ? 1.0 : 255.0 / 219;
+    double c_scale = full ? 1.0 : 255.0 / 224;
+    c->y = q13(y_scale);
+    // pmulhuw 截断平均少0.5, 和最后右移的舍入(16)一起补上
+    c->y_bias = (int16_t)lrint(16.5 - (full ? 0 : 16) * 32 * y_scale);
+    c->rv = q13(2 * (1 - kr) * c_scale);
+    c->gu = q13(2 * kb * (1 - kb) / kg * c_scale);
+    c->gv = q13(2 * kr * (1 - kr) / kg * c_scale);
+    c->bu = q13(2 * (1 - kb) * c_scale);
+}
+
+// 对应 pmulhrsw
+static inline int mulhrs(int a, int b) {
+    return (a * b + 0x4000) >> 15;
+}
+
+// 对应 psraw + packuswb; 各项之和不会超出 int16, 不需要饱和加法
+static inline uint8_t pack_pixel(int v) {
+    v >>= 5;
+    return v > 255 ? 255 : v < 0 ? 0 : v;
+}
+
+// 转换一行中 [x, width) 的像素, 也用作 SIMD 版本的行尾处理
+static void yuv2rgb_row_c(const uint8_t* py, const uint8_t* pu, const uint8_t* pv,
+                          uint8_t* dst, int x, int width, const Yuv2RgbCoeffs* c) {
+    for (; x < width; x++) {
+        int uc = (pu[x >> 1] - 128) * 128;
+        int vc = (pv[x >> 1] - 128) * 128;
+        int ys = ((py[x] << 8) * c->y >> 16) + c->y_bias;
+        dst[3 * x] = pack_pixel(ys + mulhrs(vc, c->rv));
+        dst[3 * x + 1] = pack_pixel(ys - mulhrs(uc, c->gu) - mulhrs(vc, c->gv));
+        dst[3 * x + 2] = pack_pixel(ys + mulhrs(uc, c->bu));
+    }
+}
+
+static void yuv420p_to_rgb24_c(const uint8_t* const src[3], const int src_stride[3],
+                               uint8_t* dst, int dst_stride, int width, int height,
+                               const Yuv2RgbCoeffs* c) {
+    for (int y = 0; y < height; y++) {
+        yuv2rgb_row_c(src[0] + y * src_stride[0], src[1] + (y >> 1) * src_stride[1],
+                      src[2] + (y >> 1) * src_stride[2], dst + y * dst_stride, 0, width, c);
+    }
+}
+
+#if YUV2RGB_X86
+
+// pshufb 掩码: 16个像素的 R/G/B 平面交织成48字节 RGB24 时, 第 k 个16字节从各平面取哪些字节(-1 填0)
+static const int8_t rgb24_shuffle[3][3][16] = {
+    { { 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5 },
+      { -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1 },
+      { -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1 } },
+    { { -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1 },
+      { 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10 },
+      { -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1 } },
+    { { -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 },
+      { -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 },
+      { 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 } },
+};
+
+#define SHUFFLE_MASK(k, ch) _mm_loadu_si128((const __m128i*)rgb24_shuffle[k][ch])
+#define RGB24_PART_SSE(r, g, b, k)                                                         \
+    _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, SHUFFLE_MASK(k, 0)),                    \
+                              _mm_shuffle_epi8(g, SHUFFLE_MASK(k, 1))),                   \
+                 _mm_shuffle_epi8(b, SHUFFLE_MASK(k, 2)))
+#define PIXEL_SSE(op, ys, t) _mm_srai_epi16(op(ys, t), 5)
+
+__attribute__((target("sse4.1")))
+static void yuv420p_to_rgb24_sse4(const uint8_t* const src[3], const int src_stride[3],
+                                  uint8_t* dst, int dst_stride, int width, int height,
+                                  const Yuv2RgbCoeffs* c) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i k128 = _mm_set1_epi16(128);
+    const __m128i ky = _mm_set1_epi16((short)c->y);
+    const __m128i y_bias = _mm_set1_epi16(c->y_bias);
+    const __m128i krv = _mm_set1_epi16(c->rv);
+    const __m128i kgu = _mm_set1_epi16(c->gu);
+    const __m128i kgv = _mm_set1_epi16(c->gv);
+    const __m128i kbu = _mm_set1_epi16(c->bu);
+    // 两行亮度共用一行色度, 色度项只算一次
+    for (int y = 0; y < height; y += 2) {
+        int rows = y + 1 < height ? 2 : 1;
+        const uint8_t* pu = src[1] + (y >> 1) * src_stride[1];
+        const uint8_t* pv = src[2] + (y >> 1) * src_stride[2];
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i uc = _mm_slli_epi16(_mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pu + x / 2))), k128), 7);
+            __m128i vc = _mm_slli_epi16(_mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(pv + x / 2))), k128), 7);
+            __m128i rv = _mm_mulhrs_epi16(vc, krv);
+            __m128i gt = _mm_add_epi16(_mm_mulhrs_epi16(uc, kgu), _mm_mulhrs_epi16(vc, kgv));
+            __m128i bu = _mm_mulhrs_epi16(uc, kbu);
+            // 每个色度样本复制给相邻两个像素
+            __m128i rv_lo = _mm_unpacklo_epi16(rv, rv), rv_hi = _mm_unpackhi_epi16(rv, rv);
+            __m128i gt_lo = _mm_unpacklo_epi16(gt, gt), gt_hi = _mm_unpackhi_epi16(gt, gt);
+            __m128i bu_lo = _mm_unpacklo_epi16(bu, bu), bu_hi = _mm_unpackhi_epi16(bu, bu);
+            for (int r = 0; r < rows; r++) {
+                __m128i yv = _mm_loadu_si128((const __m128i*)(src[0] + (y + r) * src_stride[0] + x));
+                // 与0交错得到 Y << 8
+                __m128i ys_lo = _mm_add_epi16(_mm_mulhi_epu16(_mm_unpacklo_epi8(zero, yv), ky), y_bias);
+                __m128i ys_hi = _mm_add_epi16(_mm_mulhi_epu16(_mm_unpackhi_epi8(zero, yv), ky), y_bias);
+                __m128i R = _mm_packus_epi16(PIXEL_SSE(_mm_add_epi16, ys_lo, rv_lo), PIXEL_SSE(_mm_add_epi16, ys_hi, rv_hi));
+                __m128i G = _mm_packus_epi16(PIXEL_SSE(_mm_sub_epi16, ys_lo, gt_lo), PIXEL_SSE(_mm_sub_epi16, ys_hi, gt_hi));
+                __m128i B = _mm_packus_epi16(PIXEL_SSE(_mm_add_epi16, ys_lo, bu_lo), PIXEL_SSE(_mm_add_epi16, ys_hi, bu_hi));
+                uint8_t* out = dst + (y + r) * dst_stride + 3 * x;
+                _mm_storeu_si128((__m128i*)out, RGB24_PART_SSE(R, G, B, 0));
+                _mm_storeu_si128((__m128i*)(out + 16), RGB24_PART_SSE(R, G, B, 1));
+                _mm_storeu_si128((__m128i*)(out + 32), RGB24_PART_SSE(R, G, B, 2));
+            }
+        }
+        for (int r = 0; r < rows; r++) {
+            yuv2rgb_row_c(src[0] + (y + r) * src_stride[0], pu, pv, dst + (y + r) * dst_stride, x, width, c);
+        }
+    }
+}
+
+#define SHUFFLE_MASK2(k, ch) _mm256_broadcastsi128_si256(SHUFFLE_MASK(k, ch))
+#define RGB24_PART_AVX2(r, g, b, k)                                                        \
+    _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(r, SHUFFLE_MASK2(k, 0)),          \
+                                    _mm256_shuffle_epi8(g, SHUFFLE_MASK2(k, 1))),         \
+                    _mm256_shuffle_epi8(b, SHUFFLE_MASK2(k, 2)))
+#define PIXEL_AVX2(op, ys, t) _mm256_srai_epi16(op(ys, t), 5)
+
+// 256位的 unpack/pack 都在128位通道内进行. 这里让 _lo 是像素 0-7|16-23, _hi 是 8-15|24-31,
+// packus 之后正好是 0-15|16-31, 两个通道各自交织, 全程不需要跨通道重排
+__attribute__((target("avx2")))
+static void yuv420p_to_rgb24_avx2(const uint8_t* const src[3], const int src_stride[3],
+                                  uint8_t* dst, int dst_stride, int width, int height,
+                                  const Yuv2RgbCoeffs* c) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i k128 = _mm256_set1_epi16(128);
+    const __m256i ky = _mm256_set1_epi16((short)c->y);
+    const __m256i y_bias = _mm256_set1_epi16(c->y_bias);
+    const __m256i krv = _mm256_set1_epi16(c->rv);
+    const __m256i kgu = _mm256_set1_epi16(c->gu);
+    const __m256i kgv = _mm256_set1_epi16(c->gv);
+    const __m256i kbu = _mm256_set1_epi16(c->bu);
+    for (int y = 0; y < height; y += 2) {
+        int rows = y + 1 < height ? 2 : 1;
+        const uint8_t* pu = src[1] + (y >> 1) * src_stride[1];
+        const uint8_t* pv = src[2] + (y >> 1) * src_stride[2];
+        int x = 0;
+        for (; x + 32 <= width; x += 32) {
+            // 色度样本 0-7|8-15
+            __m256i uc = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pu + x / 2))), k128), 7);
+            __m256i vc = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pv + x / 2))), k128), 7);
+            __m256i rv = _mm256_mulhrs_epi16(vc, krv);
+            __m256i gt = _mm256_add_epi16(_mm256_mulhrs_epi16(uc, kgu), _mm256_mulhrs_epi16(vc, kgv));
+            __m256i bu = _mm256_mulhrs_epi16(uc, kbu);
+            __m256i rv_lo = _mm256_unpacklo_epi16(rv, rv), rv_hi = _mm256_unpackhi_epi16(rv, rv);
+            __m256i gt_lo = _mm256_unpacklo_epi16(gt, gt), gt_hi = _mm256_unpackhi_epi16(gt, gt);
+            __m256i bu_lo = _mm256_unpacklo_epi16(bu, bu), bu_hi = _mm256_unpackhi_epi16(bu, bu);
+            for (int r = 0; r < rows; r++) {
+                __m256i yv = _mm256_loadu_si256((const __m256i*)(src[0] + (y + r) * src_stride[0] + x));
+                __m256i ys_lo = _mm256_add_epi16(_mm256_mulhi_epu16(_mm256_unpacklo_epi8(zero, yv), ky), y_bias);
+                __m256i ys_hi = _mm256_add_epi16(_mm256_mulhi_epu16(_mm256_unpackhi_epi8(zero, yv), ky), y_bias);
+                __m256i R = _mm256_packus_epi16(PIXEL_AVX2(_mm256_add_epi16, ys_lo, rv_lo), PIXEL_AVX2(_mm256_add_epi16, ys_hi, rv_hi));
+                __m256i G = _mm256_packus_epi16(PIXEL_AVX2(_mm256_sub_epi16, ys_lo, gt_lo), PIXEL_AVX2(_mm256_sub_epi16, ys_hi, gt_hi));
+                __m256i B = _mm256_packus_epi16(PIXEL_AVX2(_mm256_add_epi16, ys_lo, bu_lo), PIXEL_AVX2(_mm256_add_epi16, ys_hi, bu_hi));
+                // 每个通道得到输出的 0-15|48-63, 16-31|64-79, 32-47|80-95 字节
+                __m256i p0 = RGB24_PART_AVX2(R, G, B, 0);
+                __m256i p1 = RGB24_PART_AVX2(R, G, B, 1);
+                __m256i p2 = RGB24_PART_AVX2(R, G, B, 2);
+                uint8_t* out = dst + (y + r) * dst_stride + 3 * x;
+                _mm256_storeu_si256((__m256i*)out, _mm256_permute2x128_si256(p0, p1, 0x20));
+                _mm256_storeu_si256((__m256i*)(out + 32), _mm256_permute2x128_si256(p2, p0, 0x30));
+                _mm256_storeu_si256((__m256i*)(out + 64), _mm256_permute2x128_si256(p1, p2, 0x31));
+            }
+        }
+        for (int r = 0; r < rows; r++) {
+            yuv2rgb_row_c(src[0] + (y + r) * src_stride[0], pu, pv, dst + (y + r) * dst_stride, x, width, c);
+        }
+    }
+}
+
+#endif
+
+Yuv2RgbFunc yuv2rgb_get_func(int cpu_flags, const char** name) {
+    const char* dummy;
+    if (!name) {
+        name = &dummy;
+    }
+#if YUV2RGB_X86
+    if (cpu_flags & AV_CPU_FLAG_AVX2) {
+        *name = "avx2";
+        return yuv420p_to_rgb24_avx2;
+    }
+    if (cpu_flags & AV_CPU_FLAG_SSE4) {
+        *name = "sse4";
+        return yuv420p_to_rgb24_sse4;
+    }
+#endif
+    *name = "c";
+    return yuv420p_to_rgb24_c;
+}
+
+int yuv2rgb_frame(const AVFrame* src, AVFrame* dst) {
+    if ((src->format != AV_PIX_FMT_YUV420P && src->format != AV_PIX_FMT_YUVJ420P) ||
+        dst->format != AV_PIX_FMT_RGB24 || dst->width != src->width || dst->height != src->height) {
+        return -1;
+    }
+    Yuv2RgbCoeffs coeffs;
+    yuv2rgb_coeffs_init(&coeffs, src->colorspace,
+        src->format == AV_PIX_FMT_YUVJ420P ? AVCOL_RANGE_JPEG : src->color_range);
+    Yuv2RgbFunc func = yuv2rgb_get_func(av_get_cpu_flags(), NULL);
+    func((const uint8_t* const*)src->data, src->linesize, dst->data[0], dst->linesize[0],
+         src->width, src->height, &coeffs);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef COMMON_YUV2RGB_H
+#define COMMON_YUV2RGB_H
+
+#include <libavutil/frame.h>
+#include <libavutil/pixfmt.h>
+#include <stdint.h>
+
+// 同尺寸 yuv420p -> rgb24 专用转换(导出PPM的热路径), 不经过 swscale.
+// 色度按最近邻取样(每个色度样本覆盖2x2像素). 16位定点, 各项都算成32倍的 RGB 分量:
+// 亮度 (Y << 8) * y >> 16 (pmulhuw) 再加上 y_bias(含偏移和舍入), 色度 (C - 128) * 128 再与 c/4 的Q15系数
+// 做带舍入的高位乘法(pmulhrsw); 求和后右移5位截到 [0, 255], 舍入前与精确值的误差在0.1LSB以内.
+// C / SSE4.1 / AVX2 三个实现逐位相同, 运行时按 av_get_cpu_flags() 选择.
+
+// 各系数 = c * 8192
+typedef struct Yuv2RgbCoeffs {
+    uint16_t y;
+    int16_t y_bias;
+    int16_t rv;
+    int16_t gu;
+    int16_t gv;
+    int16_t bu;
+} Yuv2RgbCoeffs;
+
+typedef void (*Yuv2RgbFunc)(const uint8_t* const src[3], const int src_stride[3],
+                            uint8_t* dst, int dst_stride, int width, int height,
+                            const Yuv2RgbCoeffs* c);
+
+// BT.709 以外的矩阵都按 BT.601 处理(与 swscale 默认一致); AVCOL_RANGE_JPEG 为全范围, 其余为有限范围
+void yuv2rgb_coeffs_init(Yuv2RgbCoeffs* c, enum AVColorSpace colorspace, enum AVColorRange range);
+// 按 cpu_flags(AV_CPU_FLAG_*) 选可用的最快实现, name 可为NULL
+Yuv2RgbFunc yuv2rgb_get_func(int cpu_flags, const char** name);
+// 转换整帧到 dst(RGB24, 尺寸与 src 相同); src 不是 yuv420p/yuvj420p 时返回-1, 由调用者退回 swscale
+int yuv2rgb_frame(const AVFrame* src, AVFrame* dst);
+
+#endif
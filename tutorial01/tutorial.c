@@ -1,16 +1,489 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
+#include <libavutil/cpu.h>
+#include <libavutil/imgutils.h>
+#include <libavutil/time.h>
 #include <libswscale/swscale.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "decoder_threads.h"
+#include "file_writer.h"
+#include "frame_allocator.h"
+#include "frame_queue.h"
+#include "image_encoder.h"
+#include "slice_scaler.h"
+#include "stage_stats.h"
+#include "stream_writer.h"
+#include "yuv2rgb.h"
+
+#define EXPORT_MAX_WORKERS 64
 
 void printHelpMenu();
 void saveFrame(AVFrame* avFrame, int width, int height, int frameIndex);
 
+// 导出流水线: 解码循环 -> exportq -> N个写文件线程.
+// 每个线程有自己的缩放器和 RGB 缓冲区, 颜色转换和写文件与解码并行;
+// yuv420p 用 common/yuv2rgb 的 SIMD 转换; 其它格式走 swscale,
+// --slices 大于1时每个线程的颜色转换再按行分带并行(适合线程数少而分辨率高的情况).
+// --output y4m/raw 时不再每帧写一个 PPM, 而是由唯一的导出线程按顺序写进一个视频流(stdout 或 FIFO).
+// 图片默认编码成 QOI(--output png/ppm 可选), 编码也在导出线程里做, 直接编码进 file_writer 的缓冲区;
+// file_writer 默认 io_uring 成批异步提交, 导出线程只在缓冲区用完时才等磁盘.
+FrameQueue exportq;
+FileWriter file_writer;
+ImageFormat image_format;
+// 编码前的 RGB24 字节数, 和 file_writer 写出的字节数比较压缩率
+atomic_llong rgb_bytes;
+StreamWriter stream_writer;
+int streaming;
+StageStats decode_stats;
+StageStats convert_stats;
+StageStats encode_stats;
+StageStats write_stats;
+
+typedef struct ExportWorker {
+    SDL_Thread* thread;
+    SliceScaler scaler;
+    AVFrame* frame;
+    AVFrame* frameRGB;
+} ExportWorker;
+
+static int export_thread(void* arg) {
+    ExportWorker* worker = (ExportWorker*)arg;
+    AVFrame* pFrame = worker->frame;
+    AVFrame* pFrameRGB = worker->frameRGB;
+    while (frame_queue_get(&exportq, pFrame) > 0) {
+        int64_t start = av_gettime_relative();
+        if (streaming) {
+            stream_writer_write(&stream_writer, pFrame);
+            stage_stats_add(&write_stats, 1, av_gettime_relative() - start);
+            av_frame_unref(pFrame);
+            continue;
+        }
+        if (pFrameRGB->width != pFrame->width || pFrameRGB->height != pFrame->height) {
+            av_frame_unref(pFrameRGB);
+            pFrameRGB->format = AV_PIX_FMT_RGB24;
+            pFrameRGB->width = pFrame->width;
+            pFrameRGB->height = pFrame->height;
+            if (av_frame_get_buffer(pFrameRGB, 32) < 0) {
+                printf("av_frame_get_buffer failed\n");
+                av_frame_unref(pFrame);
+                continue;
+            }
+        }
+        // yuv420p 走专用的 SIMD 转换, 其它格式交给 swscale
+        if (yuv2rgb_frame(pFrame, pFrameRGB) < 0) {
+            // 帧尺寸或格式变化时才会重建缩放上下文
+            if (slice_scaler_configure(&worker->scaler,
+                    pFrame->width, pFrame->height, pFrame->format,
+                    pFrame->width, pFrame->height, AV_PIX_FMT_RGB24, SWS_BILINEAR) < 0) {
+                printf("slice_scaler_configure failed\n");
+                av_frame_unref(pFrame);
+                continue;
+            }
+            if (slice_scaler_scale(&worker->scaler, (uint8_t const* const*)pFrame->data, pFrame->linesize,
+                    pFrameRGB->data, pFrameRGB->linesize) < 0) {
+                printf("slice_scaler_scale failed\n");
+                av_frame_unref(pFrame);
+                continue;
+            }
+        }
+        stage_stats_add(&convert_stats, 1, av_gettime_relative() - start);
+        // 解码循环把帧序号放在 opaque 里; 编码和写文件的耗时在 saveFrame 里分别统计
+        saveFrame(pFrameRGB, pFrame->width, pFrame->height, (int)(intptr_t)pFrame->opaque);
+        av_frame_unref(pFrame);
+    }
+    return 0;
+}
+
+// 其它流的包在 demux 层就丢掉
+static void discard_other_streams(AVFormatContext* fmt_ctx, int stream_index) {
+    for (unsigned int i = 0; i < fmt_ctx->nb_streams; i++) {
+        if ((int)i != stream_index) {
+            fmt_ctx->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+}
+
+// decode_keyframe 读到了关键帧包但解不出帧(包损坏, 或 AVDISCARD_NONKEY 下开放 GOP 的恢复点),
+// 与文件读完的 AVERROR_EOF 区分开, 调用者跳过这个位置
+#define DECODE_KEYFRAME_EMPTY 1
+
+// 从当前读位置往后找第一个视频关键帧包, 只解码这一包.
+// 送完包马上送空包进入 drain, 让解码器(包括帧级多线程)立即吐出这一帧, 不必再多读包;
+// 取到帧后 flush 清掉 EOF 状态, 下一次 seek 后可以继续送包.
+static int decode_keyframe(AVFormatContext* fmt_ctx, AVCodecContext* codec_ctx, int stream_index,
+                           AVPacket* packet, AVFrame* frame, int* nb_packets) {
+    int ret;
+    while ((ret = av_read_frame(fmt_ctx, packet)) >= 0) {
+        (*nb_packets)++;
+        if (packet->stream_index == stream_index && (packet->flags & AV_PKT_FLAG_KEY)) {
+            break;
+        }
+        av_packet_unref(packet);
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    ret = avcodec_send_packet(codec_ctx, packet);
+    av_packet_unref(packet);
+    if (ret == AVERROR_INVALIDDATA) {
+        return DECODE_KEYFRAME_EMPTY;
+    } else if (ret < 0) {
+        return ret;
+    }
+    avcodec_send_packet(codec_ctx, NULL);
+    ret = avcodec_receive_frame(codec_ctx, frame);
+    avcodec_flush_buffers(codec_ctx);
+    // drain 的 EOF 只说明这一包没有出帧, 文件本身还没读完
+    return ret == AVERROR_EOF ? DECODE_KEYFRAME_EMPTY : ret;
+}
+
+// 缩略图模式: 把时长均分成 nb_thumbnails 段, 在每段中点 seek 到之前最近的关键帧, 只解码这一个关键帧,
+// 解码器设置 AVDISCARD_NONKEY 丢掉其它帧. 耗时只跟缩略图数量有关, 与文件时长无关.
+// 关键帧稀疏时相邻两段可能落到同一个关键帧, 这种重复的跳过不导出; 关键帧包解不出帧的位置也跳过.
+static int extract_thumbnails(AVFormatContext* fmt_ctx, AVCodecContext* codec_ctx, int stream_index,
+                              int nb_thumbnails, AVPacket* packet, AVFrame* frame) {
+    AVStream* st = fmt_ctx->streams[stream_index];
+    int64_t duration = fmt_ctx->duration;
+    if (duration == AV_NOPTS_VALUE || duration <= 0) {
+        if (st->duration == AV_NOPTS_VALUE || st->duration <= 0) {
+            printf("unknown duration, can not pick thumbnail positions\n");
+            return -1;
+        }
+        duration = av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q);
+    }
+    int64_t start_time = fmt_ctx->start_time == AV_NOPTS_VALUE ? 0 : fmt_ctx->start_time;
+    discard_other_streams(fmt_ctx, stream_index);
+    codec_ctx->skip_frame = AVDISCARD_NONKEY;
+
+    int exported = 0;
+    int duplicates = 0;
+    int skipped = 0;
+    int nb_packets = 0;
+    int64_t last_pts = AV_NOPTS_VALUE;
+    for (int k = 0; k < nb_thumbnails; k++) {
+        int64_t start = av_gettime_relative();
+        int64_t target = start_time + duration * (2 * k + 1) / (2 * nb_thumbnails);
+        int64_t ts = av_rescale_q(target, AV_TIME_BASE_Q, st->time_base);
+        if (av_seek_frame(fmt_ctx, stream_index, ts, AVSEEK_FLAG_BACKWARD) < 0) {
+            printf("av_seek_frame failed\n");
+            return -1;
+        }
+        avcodec_flush_buffers(codec_ctx);
+        int ret = decode_keyframe(fmt_ctx, codec_ctx, stream_index, packet, frame, &nb_packets);
+        if (ret == AVERROR_EOF) {
+            break;
+        } else if (ret == DECODE_KEYFRAME_EMPTY) {
+            printf("thumbnail at %.3fs: keyframe decoded no frame, skipped\n", target / (double)AV_TIME_BASE);
+            skipped++;
+            continue;
+        } else if (ret < 0) {
+            printf("decode keyframe failed\n");
+            return -1;
+        }
+        int64_t pts = frame->best_effort_timestamp;
+        if (pts != AV_NOPTS_VALUE && pts == last_pts) {
+            duplicates++;
+            av_frame_unref(frame);
+            continue;
+        }
+        last_pts = pts;
+        stage_stats_add(&decode_stats, 1, av_gettime_relative() - start);
+        printf("thumbnail %d: target %.3fs, keyframe %.3fs\n", exported + 1,
+            target / (double)AV_TIME_BASE,
+            pts == AV_NOPTS_VALUE ? -1.0 : pts * av_q2d(st->time_base));
+        frame->opaque = (void*)(intptr_t)++exported;
+        frame_queue_put(&exportq, frame);
+    }
+    printf("thumbnails: %d exported, %d duplicate keyframes skipped, %d keyframes without a frame skipped, "
+           "%d packets read\n",
+        exported, duplicates, skipped, nb_packets);
+    return 0;
+}
+
+typedef struct PtsRange {
+    int64_t start;
+    int64_t end;
+} PtsRange;
+
+static int compare_ranges(const void* a, const void* b) {
+    const PtsRange* ra = (const PtsRange*)a;
+    const PtsRange* rb = (const PtsRange*)b;
+    return ra->start < rb->start ? -1 : ra->start > rb->start;
+}
+
+static int add_range(PtsRange** ranges, int* nb_ranges, int64_t start, int64_t end) {
+    PtsRange* tmp = av_realloc_array(*ranges, *nb_ranges + 1, sizeof(PtsRange));
+    if (!tmp) {
+        return -1;
+    }
+    tmp[*nb_ranges].start = start;
+    tmp[*nb_ranges].end = end;
+    *ranges = tmp;
+    (*nb_ranges)++;
+    return 0;
+}
+
+// 帧列表文件: 每行一个 pts, 或者 "起始-结束" 的闭区间, 单位是视频流的 time_base; # 开头的行是注释
+static int load_frame_list(const char* path, PtsRange** ranges, int* nb_ranges) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        printf("Could not open frame list %s\n", path);
+        return -1;
+    }
+    char line[256];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), f)) {
+        long long start, end;
+        line_no++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+            continue;
+        }
+        int n = sscanf(line, "%lld-%lld", &start, &end);
+        if (n < 1) {
+            printf("%s:%d: invalid line\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+        if (add_range(ranges, nb_ranges, start, n == 2 ? end : start) < 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// 排序并合并重叠/相邻的区间, 之后可以按 pts 单调地往后解码
+static void merge_ranges(PtsRange* ranges, int* nb_ranges) {
+    int n = 0;
+    qsort(ranges, *nb_ranges, sizeof(PtsRange), compare_ranges);
+    for (int i = 0; i < *nb_ranges; i++) {
+        if (n > 0 && ranges[i].start <= ranges[n - 1].end + 1) {
+            ranges[n - 1].end = FFMAX(ranges[n - 1].end, ranges[i].end);
+        } else {
+            ranges[n++] = ranges[i];
+        }
+    }
+    *nb_ranges = n;
+}
+
+// 下一个目标是 seek 过去还是从当前位置 pos 继续往后解码:
+// 目标不在 pos 之后时(区间已排序合并, 连续的帧列表每一项都是这样)当前帧可能就在区间里, 继续往后解码;
+// 有索引时看目标之前最近的关键帧是否已经在 pos 之前(是的话 seek 也只会回到已解码过的位置);
+// 没有索引(如 TS)时, 距离不超过见过的最大关键帧间隔就继续解码, 代价不比 seek 后从关键帧解码大.
+static int need_seek(AVStream* st, int64_t target, int64_t pos, int64_t gop) {
+    if (pos == AV_NOPTS_VALUE) {
+        return 1;
+    }
+    if (target <= pos) {
+        return 0;
+    }
+    const AVIndexEntry* entry = avformat_index_get_entry_from_timestamp(st, target, AVSEEK_FLAG_BACKWARD);
+    if (entry) {
+        return entry->timestamp > pos;
+    }
+    return gop <= 0 || target - pos > gop;
+}
+
+// 区间模式: 只导出 pts 落在 ranges 里的帧(最多 max_frames 张).
+// 每个区间 seek 到之前最近的关键帧往后解码, 区间之前的帧解码后直接丢弃, 不做颜色转换.
+static int extract_ranges(AVFormatContext* fmt_ctx, AVCodecContext* codec_ctx, int stream_index,
+                          const PtsRange* ranges, int nb_ranges, int max_frames,
+                          AVPacket* packet, AVFrame* frame) {
+    AVStream* st = fmt_ctx->streams[stream_index];
+    discard_other_streams(fmt_ctx, stream_index);
+    printf("extracting %d pts ranges, time base %d/%d\n", nb_ranges, st->time_base.num, st->time_base.den);
+
+    int cur = 0;
+    int seek = 1;
+    int eof = 0;
+    int decoded = 0;
+    int emitted = 0;
+    int nb_seeks = 0;
+    int64_t pos = AV_NOPTS_VALUE;
+    int64_t last_key = AV_NOPTS_VALUE;
+    int64_t gop = 0;
+    int64_t start = av_gettime_relative();
+    while (cur < nb_ranges && emitted < max_frames && !eof) {
+        if (seek) {
+            // 目标在第一个关键帧之前时往前找不到关键帧, 改为往后找
+            if (av_seek_frame(fmt_ctx, stream_index, ranges[cur].start, AVSEEK_FLAG_BACKWARD) < 0 &&
+                av_seek_frame(fmt_ctx, stream_index, ranges[cur].start, 0) < 0) {
+                printf("av_seek_frame failed\n");
+                return -1;
+            }
+            avcodec_flush_buffers(codec_ctx);
+            nb_seeks++;
+            seek = 0;
+            pos = AV_NOPTS_VALUE;
+        }
+        int ret = av_read_frame(fmt_ctx, packet);
+        if (ret < 0) {
+            // 文件读完, 把解码器里剩下的帧取出来
+            eof = 1;
+            avcodec_send_packet(codec_ctx, NULL);
+        } else if (packet->stream_index != stream_index) {
+            av_packet_unref(packet);
+            continue;
+        } else {
+            ret = avcodec_send_packet(codec_ctx, packet);
+            av_packet_unref(packet);
+            if (ret < 0) {
+                printf("avcodec_send_packet failed\n");
+                return -1;
+            }
+        }
+        while (!seek && (ret = avcodec_receive_frame(codec_ctx, frame)) >= 0) {
+            int64_t pts = frame->best_effort_timestamp;
+            decoded++;
+            if (pts == AV_NOPTS_VALUE) {
+                av_frame_unref(frame);
+                continue;
+            }
+            if (frame->key_frame) {
+                if (last_key != AV_NOPTS_VALUE && pts > last_key) {
+                    gop = FFMAX(gop, pts - last_key);
+                }
+                last_key = pts;
+            }
+            pos = pts;
+            while (cur < nb_ranges && pts > ranges[cur].end) {
+                cur++;
+                // 文件已经读完时不再 seek: 解码器里缓冲的帧要全部取出来, 和剩下的区间逐个比较
+                if (!eof && cur < nb_ranges && need_seek(st, ranges[cur].start, pos, gop)) {
+                    seek = 1;
+                }
+            }
+            if (!seek && cur < nb_ranges && pts >= ranges[cur].start && emitted < max_frames) {
+                stage_stats_add(&decode_stats, 1, av_gettime_relative() - start);
+                printf("frame %d: pts %lld\n", emitted + 1, (long long)pts);
+                frame->opaque = (void*)(intptr_t)++emitted;
+                frame_queue_put(&exportq, frame);
+                start = av_gettime_relative();
+            } else {
+                av_frame_unref(frame);
+            }
+        }
+        if (ret < 0 && ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) {
+            printf("avcodec_receive_frame failed\n");
+            return -1;
+        }
+    }
+    printf("ranges: %d frames decoded, %d emitted, %d seeks\n", decoded, emitted, nb_seeks);
+    return 0;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
+    int nb_workers = av_cpu_count();
+    int nb_slices = 1;
+    int thumbnails = 0;
+    int64_t range_start = AV_NOPTS_VALUE;
+    int64_t range_end = AV_NOPTS_VALUE;
+    PtsRange* ranges = NULL;
+    int nb_ranges = 0;
+    const char* output = "qoi";
+    const char* output_path = "-";
+    const char* io = "uring";
+    DecoderThreads decoder_threads;
+    decoder_threads_init(&decoder_threads);
+    int frame_buffers = FRAME_BUFFERS_POOL;
+    if (argc < 3) {
+        printHelpMenu();
+        return -1;
+    }
+    for (int arg = 3; arg < argc; arg++) {
+        if (arg + 1 < argc && strcmp(argv[arg], "--workers") == 0) {
+            if (sscanf(argv[++arg], "%d", &nb_workers) != 1) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--slices") == 0) {
+            if (sscanf(argv[++arg], "%d", &nb_slices) != 1) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (strcmp(argv[arg], "--thumbnails") == 0) {
+            thumbnails = 1;
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--start") == 0) {
+            if (sscanf(argv[++arg], "%" SCNd64, &range_start) != 1) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--end") == 0) {
+            if (sscanf(argv[++arg], "%" SCNd64, &range_end) != 1) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--frames") == 0) {
+            if (load_frame_list(argv[++arg], &ranges, &nb_ranges) < 0) {
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--output") == 0) {
+            output = argv[++arg];
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--out") == 0) {
+            output_path = argv[++arg];
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--io") == 0) {
+            io = argv[++arg];
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0) {
+            if (sscanf(argv[++arg], "%d", &decoder_threads.count) != 1) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--thread-type") == 0) {
+            if (decoder_threads_parse_type(&decoder_threads, argv[++arg]) < 0) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--frame-buffers") == 0) {
+            frame_buffers = frame_allocator_parse_mode(argv[++arg]);
+            if (frame_buffers < 0) {
+                printHelpMenu();
+                return -1;
+            }
+        } else {
+            printHelpMenu();
+            return -1;
+        }
+    }
+    if (range_start != AV_NOPTS_VALUE || range_end != AV_NOPTS_VALUE) {
+        if (add_range(&ranges, &nb_ranges,
+                range_start == AV_NOPTS_VALUE ? 0 : range_start,
+                range_end == AV_NOPTS_VALUE ? INT64_MAX - 1 : range_end) < 0) {
+            printf("add_range failed\n");
+            return -1;
+        }
+    }
+    merge_ranges(ranges, &nb_ranges);
+    if (nb_workers < 1) {
+        nb_workers = 1;
+    } else if (nb_workers > EXPORT_MAX_WORKERS) {
+        nb_workers = EXPORT_MAX_WORKERS;
+    }
+    if (strcmp(output, "y4m") == 0 || strcmp(output, "raw") == 0) {
+        // 要在任何日志输出之前打开: 写 stdout 时会把日志改到 stderr. 帧率等找到视频流后再填
+        if (stream_writer_open(&stream_writer, output_path,
+                strcmp(output, "y4m") == 0 ? STREAM_Y4M : STREAM_RAW, (AVRational){ 25, 1 }) < 0) {
+            return -1;
+        }
+        streaming = 1;
+        // 帧必须按解码顺序写进同一个流
+        nb_workers = 1;
+    } else if (image_format_from_name(output) < 0 || (strcmp(io, "uring") != 0 && strcmp(io, "stdio") != 0)) {
         printHelpMenu();
         return -1;
+    } else {
+        image_format = image_format_from_name(output);
+        // 每个导出线程手上一个缓冲区, 其余的在内核里排队写
+        if (file_writer_init(&file_writer, nb_workers * 2 + 2, strcmp(io, "uring") == 0) < 0) {
+            return -1;
+        }
     }
     AVFormatContext* pFormatCtx = NULL;
     // 打开视频文件, 并且初始化
@@ -35,7 +508,7 @@ int main(int argc, char* argv[]) {
     AVCodecContext* pCodecCtx = NULL;
 
     int videoStream = -1; // 找到第一个视频流
-    for (i = 0; i < pFormatCtx->nb_streams; i++) {
+    for (i = 0; i < (int)pFormatCtx->nb_streams; i++) {
         if (pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             videoStream = i;
             break;
@@ -44,6 +517,12 @@ int main(int argc, char* argv[]) {
     if (videoStream == -1) {
         return -1;
     }
+    if (streaming) {
+        AVRational frame_rate = av_guess_frame_rate(pFormatCtx, pFormatCtx->streams[videoStream], NULL);
+        if (frame_rate.num > 0 && frame_rate.den > 0) {
+            stream_writer.frame_rate = frame_rate;
+        }
+    }
     // 获取解码器
     AVCodec* pCodec = NULL;
     pCodec = avcodec_find_decoder(pFormatCtx->streams[videoStream]->codecpar->codec_id);
@@ -72,12 +551,19 @@ int main(int argc, char* argv[]) {
     }
 
 
-    // 打开解码器
+    // 打开解码器, 线程数和方式, 帧缓冲区的分配方式要在打开之前设置
+    FrameAllocator frame_allocator;
+    if (frame_allocator_init(&frame_allocator, frame_buffers) < 0) {
+        return -1;
+    }
+    frame_allocator_attach(&frame_allocator, pCodecCtx);
+    decoder_threads_apply(&decoder_threads, pCodecCtx);
     ret = avcodec_open2(pCodecCtx, pCodec, NULL);
     if (ret < 0) {
         printf("avcodec_open2 failed\n");
         return -1;
     }
+    decoder_threads_print(pCodecCtx, "video");
 
     // 现在我们需要一个地方去存放解码后的帧
     AVFrame* pFrame = NULL;
@@ -86,106 +572,137 @@ int main(int argc, char* argv[]) {
         printf("av_frame_alloc failed\n");
         return -1;
     }
-    // 分配RGB帧
-    // 因为我们想要输出ppm文件, 它实际上存的是24bit的RGB. 我们需要从它原始格式转换我们的帧为RGB. 但是ffmpeg 会自动帮我们做转换.
-    // 我们来创建一个帧给转换帧存放:
-    AVFrame* pFrameRGB = NULL;
-    pFrameRGB = av_frame_alloc(); // 分配一个帧, 等会用于存储RGB帧
-    if (pFrameRGB == NULL) {
-        printf("av_frame_alloc failed\n");
-        return -1;
-    }
-    // 即使我们已经创建好帧了, 当我们在转换过程中时, 仍然需要一个地方保存原始(Raw)数据.
-    // 我们使用avpicture_get_size 去获取我们需要的buffer大小.
-    uint8_t* buffer = NULL;
-    int numBytes;
-
-    // numBytes = avpicture_get_size(AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
-    numBytes = av_image_get_buffer_size(AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height, 32);
-    buffer = (uint8_t*)av_malloc(numBytes*sizeof(uint8_t));
-
-    // 填充RGB帧 -> 将缓冲区与pFrameRGB 关联.
-    // avpicture_fill((AVPicture*)pFrameRGB, buffer, AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
-    av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, buffer, AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height, 32);
-
-    // 初始化缩放上下文
-
-    // 终于, 我们现在可以从流中读取数据.
-    // 接下来我们要做的就是把一整个视频流从包(packet)中读取出来, 解码到我们得帧, 然后只要帧完毕, 我们就会转化它并且保存它.
-    struct SwsContext* sws_ctx = NULL;
+    // 因为我们想要输出ppm文件, 它实际上存的是24bit的RGB. 我们需要从它原始格式转换我们的帧为RGB.
+    // 转换放到导出线程里做, 每个线程各自分配RGB帧和缩放上下文.
     AVPacket* pPacket = av_packet_alloc();
     if (pPacket == NULL) {
         printf("av_packet_alloc failed\n");
         return -1;
     }
-    // 创建一个缩放的上下文
-    sws_ctx = sws_getContext(
-        pCodecCtx->width, pCodecCtx->height,
-        pCodecCtx->pix_fmt,
-        pCodecCtx->width, pCodecCtx->height,
-        AV_PIX_FMT_RGB24,
-        SWS_BILINEAR, NULL, NULL, NULL
-    );
+
+    // 队列大小跟线程数走, 让每个线程手上有一帧, 再多缓冲一帧
+    if (frame_queue_init(&exportq, nb_workers * 2) < 0) {
+        return -1;
+    }
+    stage_stats_init(&decode_stats, "decode");
+    stage_stats_init(&convert_stats, "convert");
+    stage_stats_init(&encode_stats, "encode");
+    stage_stats_init(&write_stats, "write");
+    ExportWorker workers[EXPORT_MAX_WORKERS];
+    memset(workers, 0, sizeof(workers));
+    for (i = 0; i < nb_workers; i++) {
+        slice_scaler_init(&workers[i].scaler, nb_slices);
+        workers[i].frame = av_frame_alloc();
+        workers[i].frameRGB = av_frame_alloc();
+        if (!workers[i].frame || !workers[i].frameRGB) {
+            printf("av_frame_alloc failed\n");
+            return -1;
+        }
+        workers[i].thread = SDL_CreateThread(export_thread, "export", &workers[i]);
+        if (!workers[i].thread) {
+            printf("Could not create thread - %s\n", SDL_GetError());
+            return -1;
+        }
+    }
+    printf("exporting with %d worker threads, %d slices each\n", nb_workers, nb_slices);
 
     int maxFramesToDecode;
     sscanf(argv[2], "%d", &maxFramesToDecode);
-    // 读取和解码帧
-    i = 0;
-    while (av_read_frame(pFormatCtx, pPacket) >= 0) {
-        // 读取一个包, 是否来自视频流?
-        if (pPacket->stream_index == videoStream) {
-            // 解码视频流
-            // avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &pPacket);
-            // Deprecated! Use avcodec_send_packet() and avcodec_receive_frame().
-            ret = avcodec_send_packet(pCodecCtx, pPacket);
-            if (ret < 0) {
-                printf("avcodec_send_packet failed\n");
-                return -1;
-            }
-            printf("av_read_frame read packet: %d\n", ret);
-            while (ret >= 0) {
-                // 循环解码包
-                // 也许有多个帧, 确保每个帧都处理过后再开始读取下一个包
-                ret = avcodec_receive_frame(pCodecCtx, pFrame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                    break;
-                } else if (ret < 0) {
-                    printf("avcodec_receive_frame failed\n");
+    if (thumbnails) {
+        // 缩略图模式下 max-frames 是缩略图张数
+        extract_thumbnails(pFormatCtx, pCodecCtx, videoStream, maxFramesToDecode, pPacket, pFrame);
+    } else if (nb_ranges > 0) {
+        extract_ranges(pFormatCtx, pCodecCtx, videoStream, ranges, nb_ranges, maxFramesToDecode, pPacket, pFrame);
+    } else {
+        // 读取和解码帧
+        i = 0;
+        int64_t start = av_gettime_relative();
+        while (av_read_frame(pFormatCtx, pPacket) >= 0) {
+            // 读取一个包, 是否来自视频流?
+            if (pPacket->stream_index == videoStream) {
+                // 解码视频流
+                // avcodec_decode_video2(pCodecCtx, pFrame, &frameFinished, &pPacket);
+                // Deprecated! Use avcodec_send_packet() and avcodec_receive_frame().
+                ret = avcodec_send_packet(pCodecCtx, pPacket);
+                if (ret < 0) {
+                    printf("avcodec_send_packet failed\n");
                     return -1;
                 }
-                // 缩放帧
-                sws_scale(sws_ctx, (uint8_t const* const*)pFrame->data, pFrame->linesize, 0, pCodecCtx->height, pFrameRGB->data, pFrameRGB->linesize);
-                if (++i <= maxFramesToDecode) {
-                    saveFrame(pFrameRGB, pCodecCtx->width, pCodecCtx->height, i);
-                    // 打印日志信息:
-                    // printf("Frame: %c(%d) pts %d dts %d key_frame %d "
-                    // "[coded_picture_number %d, display_picture_number %d,"
-                    // " %dx%d]\n",
-                    //     av_get_picture_type_char(pFrame->pict_type),
-                    //     pCodecCtx->frame_number,
-                    //     pFrameRGB->pts,
-                    //     pFrameRGB->pkt_dts,
-                    //     pFrameRGB->key_frame,
-                    //     pFrameRGB->coded_picture_number,
-                    //     pFrameRGB->display_picture_number,
-                    //     pCodecCtx->width,
-                    //     pCodecCtx->height
-                    // );
-                } else {
+                printf("av_read_frame read packet: %d\n", ret);
+                while (ret >= 0) {
+                    // 循环解码包
+                    // 也许有多个帧, 确保每个帧都处理过后再开始读取下一个包
+                    ret = avcodec_receive_frame(pCodecCtx, pFrame);
+                    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                        break;
+                    } else if (ret < 0) {
+                        printf("avcodec_receive_frame failed\n");
+                        return -1;
+                    }
+                    if (++i <= maxFramesToDecode) {
+                        stage_stats_add(&decode_stats, 1, av_gettime_relative() - start);
+                        // 交给导出线程转换并保存; exportq 满时在这里阻塞, 不计入解码耗时
+                        pFrame->opaque = (void*)(intptr_t)i;
+                        frame_queue_put(&exportq, pFrame);
+                        start = av_gettime_relative();
+                        // 打印日志信息:
+                        // printf("Frame: %c(%d) pts %d dts %d key_frame %d "
+                        // "[coded_picture_number %d, display_picture_number %d,"
+                        // " %dx%d]\n",
+                        //     av_get_picture_type_char(pFrame->pict_type),
+                        //     pCodecCtx->frame_number,
+                        //     pFrameRGB->pts,
+                        //     pFrameRGB->pkt_dts,
+                        //     pFrameRGB->key_frame,
+                        //     pFrameRGB->coded_picture_number,
+                        //     pFrameRGB->display_picture_number,
+                        //     pCodecCtx->width,
+                        //     pCodecCtx->height
+                        // );
+                    } else {
+                        break;
+                    }
+                }
+                if (i > maxFramesToDecode) {
                     break;
                 }
             }
-            if (i > maxFramesToDecode) {
-                break;
-            }
+            av_packet_unref(pPacket);
         }
-        av_packet_unref(pPacket);
     }
+    // 等导出线程把队列里剩下的帧写完
+    frame_queue_finish(&exportq);
+    for (i = 0; i < nb_workers; i++) {
+        SDL_WaitThread(workers[i].thread, NULL);
+        slice_scaler_free(&workers[i].scaler);
+        av_frame_free(&workers[i].frame);
+        av_frame_free(&workers[i].frameRGB);
+    }
+    if (streaming) {
+        stream_writer_close(&stream_writer);
+    } else {
+        // 等最后一批文件写完, 写文件耗时才完整
+        file_writer_flush(&file_writer);
+    }
+    stage_stats_print(&decode_stats);
+    stage_stats_print(&convert_stats);
+    if (!streaming) {
+        stage_stats_print(&encode_stats);
+    }
+    stage_stats_print(&write_stats);
+    frame_allocator_print_stats(&frame_allocator);
+    if (!streaming) {
+        int64_t nb_files = file_writer.nb_files;
+        printf("%s: %.1f KB/frame, %.1f%% of rgb24\n", image_format_extension(image_format),
+            nb_files > 0 ? file_writer.bytes / 1024.0 / nb_files : 0.0,
+            atomic_load(&rgb_bytes) > 0 ? file_writer.bytes * 100.0 / atomic_load(&rgb_bytes) : 0.0);
+        file_writer_print_stats(&file_writer);
+        file_writer_destroy(&file_writer);
+    }
+    frame_queue_destroy(&exportq);
+    av_free(ranges);
+
     // cleanup:
-    // Free RGB image
-    av_free(buffer);
-    av_frame_free(&pFrameRGB);
-    av_free(pFrameRGB);
     // Free YUV frame
     av_frame_free(&pFrame);
     av_free(pFrame);
@@ -193,6 +710,7 @@ int main(int argc, char* argv[]) {
     // Close the codecs
     avcodec_close(pCodecCtx);
     avcodec_close(pCodecCtxOrig);
+    frame_allocator_destroy(&frame_allocator);
 
     avformat_close_input(&pFormatCtx);
 
@@ -201,23 +719,47 @@ int main(int argc, char* argv[]) {
 
 void printHelpMenu() {
     printf("Invalid arguments.\n\n");
-    printf("Usage: ./tutorial01 <filename> <max-frames-to-decode>\n\n");
+    printf("Usage: ./tutorial01 <filename> <max-frames-to-decode> [--workers N] [--slices N] [--thumbnails]\n"
+           "       [--start PTS] [--end PTS] [--frames FILE] [--output qoi|png|ppm|y4m|raw] [--out PATH]\n"
+           "       [--io uring|stdio] [--threads N] [--thread-type auto|frame|slice|both]\n"
+           "       [--frame-buffers default|pool|huge]\n\n");
+    printf("  --thumbnails  export <max-frames-to-decode> keyframes evenly spaced over the file\n");
+    printf("  --start PTS / --end PTS  only export frames in this pts range (video stream time base)\n");
+    printf("  --frames FILE  only export frames listed in FILE, one pts or \"start-end\" range per line\n");
+    printf("  --output qoi|png|ppm|y4m|raw  qoi (default), png and ppm write tmp/frameN.<ext>,\n"
+           "                    y4m/raw stream all frames to --out\n");
+    printf("  --out PATH  stream destination, a file or FIFO; \"-\" (default) is stdout\n");
+    printf("  --io uring|stdio  how image files are written; uring (default) batches async writes\n"
+           "                    and falls back to stdio when io_uring is not available\n");
+    printf("  --threads N  decoder threads, 0 (default) picks from the number of cores\n");
+    printf("  --thread-type auto|frame|slice|both  decoder threading, auto (default) lets the codec choose\n");
+    printf("  --frame-buffers default|pool|huge  decoded frame buffers: libavcodec's own, aligned size-class\n"
+           "                    pools (default), or pools backed by transparent huge pages\n\n");
     printf(
         "e.g: ./tutorial01 /home/rambodrahmani/Videos/Labrinth-Jealous.mp4 "
         "200\n");
 }
 
 void saveFrame(AVFrame* avFrame, int width, int height, int i) {
-    FILE* pf;
     char szFilename[32];
-    int y;
-    sprintf(szFilename, "tmp/frame%d.ppm", i);
-    pf = fopen(szFilename, "wb");
-    if (pf == NULL) return;
+    int64_t start = av_gettime_relative();
+    sprintf(szFilename, "tmp/frame%d.%s", i, image_format_extension(image_format));
+    // 直接编码进 file_writer 的缓冲区, 按最坏情况的大小取
+    uint8_t* buf;
+    size_t bound = image_encode_bound(image_format, width, height);
+    int slot = file_writer_acquire(&file_writer, bound, &buf);
+    if (slot < 0) return;
 
-    fprintf(pf, "P6\n%d %d\n255\n", width, height);
-    for (y = 0; y < height; y++) {
-        fwrite(avFrame->data[0] + y*avFrame->linesize[0], 1, width*3, pf);
+    int64_t acquired = av_gettime_relative();
+    int64_t size = image_encode(image_format, avFrame->data[0], avFrame->linesize[0], width, height, buf, bound);
+    int64_t encoded = av_gettime_relative();
+    stage_stats_add(&encode_stats, 1, encoded - acquired);
+    if (size < 0) {
+        printf("image_encode failed\n");
+        file_writer_release(&file_writer, slot);
+        return;
     }
-    fclose(pf);
-}
\ No newline at end of file
+    atomic_fetch_add(&rgb_bytes, (int64_t)width * 3 * height);
+    file_writer_submit(&file_writer, slot, szFilename, size);
+    stage_stats_add(&write_stats, 1, (acquired - start) + (av_gettime_relative() - encoded));
+}
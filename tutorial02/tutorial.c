@@ -1,29 +1,73 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
-#include <libswscale/swscale.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
 
 #include <SDL.h>
 #include <SDL_thread.h>
 
 #include <stdio.h>
+#include <string.h>
+
+#include "decoder_threads.h"
+#include "frame_allocator.h"
+#include "mmap_input.h"
+#include "video_texture.h"
 
 void printHelpMenu();
 void saveFrame(AVFrame* avFrame, int width, int height, int frameIndex);
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
+    DecoderThreads decoder_threads;
+    decoder_threads_init(&decoder_threads);
+    // --null-video: 不开窗口, 帧照常转换上传到内存后丢弃; --fast: 不按pts等待, 全速跑
+    int null_video = 0;
+    int fast = 0;
+    // --mmap: 输入文件 mmap 后通过自定义 AVIOContext 读, 不走 read()
+    int use_mmap = 0;
+    int frame_buffers = FRAME_BUFFERS_POOL;
+    if (argc < 3) {
         printHelpMenu();
         return -1;
     }
+    for (int arg = 3; arg < argc; arg++) {
+        if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0) {
+            if (sscanf(argv[++arg], "%d", &decoder_threads.count) != 1) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--thread-type") == 0) {
+            if (decoder_threads_parse_type(&decoder_threads, argv[++arg]) < 0) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--frame-buffers") == 0) {
+            frame_buffers = frame_allocator_parse_mode(argv[++arg]);
+            if (frame_buffers < 0) {
+                printHelpMenu();
+                return -1;
+            }
+        } else if (strcmp(argv[arg], "--null-video") == 0) {
+            null_video = 1;
+        } else if (strcmp(argv[arg], "--fast") == 0) {
+            fast = 1;
+        } else if (strcmp(argv[arg], "--mmap") == 0) {
+            use_mmap = 1;
+        } else {
+            printHelpMenu();
+            return -1;
+        }
+    }
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0) {
+    if (SDL_Init(null_video ? SDL_INIT_TIMER : SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0) {
         printf("SDL_Init failed\n");
         return -1;
     }
     AVFormatContext* pFormatCtx = NULL;
+    MmapInput input;
     // 打开视频文件, 并且初始化
-    int ret = avformat_open_input(&pFormatCtx, argv[1], NULL, NULL);
+    int ret = mmap_input_open(&input, argv[1], use_mmap, &pFormatCtx);
     if (ret < 0) {
         printf("avformat_open_input failed\n");
         return -1;
@@ -44,7 +88,7 @@ int main(int argc, char* argv[]) {
     AVCodecContext* pCodecCtx = NULL;
 
     int videoStream = -1; // 找到第一个视频流
-    for (i = 0; i < pFormatCtx->nb_streams; i++) {
+    for (i = 0; i < (int)pFormatCtx->nb_streams; i++) {
         if (pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
             videoStream = i;
             break;
@@ -81,12 +125,19 @@ int main(int argc, char* argv[]) {
     }
 
 
-    // 打开解码器
+    // 打开解码器, 线程数和方式, 帧缓冲区的分配方式要在打开之前设置
+    FrameAllocator frame_allocator;
+    if (frame_allocator_init(&frame_allocator, frame_buffers) < 0) {
+        return -1;
+    }
+    frame_allocator_attach(&frame_allocator, pCodecCtx);
+    decoder_threads_apply(&decoder_threads, pCodecCtx);
     ret = avcodec_open2(pCodecCtx, pCodec, NULL);
     if (ret < 0) {
         printf("avcodec_open2 failed\n");
         return -1;
     }
+    decoder_threads_print(pCodecCtx, "video");
 
     // 现在我们需要一个地方去存放解码后的帧
     AVFrame* pFrame = NULL;
@@ -96,68 +147,62 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
-    SDL_Window* screen = SDL_CreateWindow(
-      "SDL Video Player",
-      SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-      pCodecCtx->width / 2, pCodecCtx->height / 2,
-      SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI
-    );
-    if (!screen) {
-        printf("SDL_CreateWindow failed\n");
-        return -1;
-    }
-    SDL_GL_SetSwapInterval(1);
+    SDL_Window* screen = NULL;
     SDL_Renderer* render = NULL;
-    render = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED|SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_TARGETTEXTURE);
-    SDL_Texture* texture = NULL;
-    texture = SDL_CreateTexture(
-      render, SDL_PIXELFORMAT_YV12, SDL_TEXTUREACCESS_STREAMING,
-      pCodecCtx->width, pCodecCtx->height
-    );
-    // 分配RGB帧
-    // 因为我们想要输出ppm文件, 它实际上存的是24bit的RGB. 我们需要从它原始格式转换我们的帧为RGB. 但是ffmpeg 会自动帮我们做转换.
-    // 我们来创建一个帧给转换帧存放:
-    AVFrame* pFrameRGB = NULL;
-    pFrameRGB = av_frame_alloc(); // 分配一个帧, 等会用于存储RGB帧
-    if (pFrameRGB == NULL) {
-        printf("av_frame_alloc failed\n");
-        return -1;
+    if (!null_video) {
+        screen = SDL_CreateWindow(
+          "SDL Video Player",
+          SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+          pCodecCtx->width / 2, pCodecCtx->height / 2,
+          SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE
+        );
+        if (!screen) {
+            printf("SDL_CreateWindow failed\n");
+            return -1;
+        }
+        SDL_GL_SetSwapInterval(1);
+        render = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED|SDL_RENDERER_PRESENTVSYNC|SDL_RENDERER_TARGETTEXTURE);
+    }
+    // 纹理按解码器输出的格式创建: YUV420P/NV12/NV21 直接上传解码帧的平面,
+    // 其他格式才用swscale转成YUV420P, 省掉一次整帧的中间拷贝.
+    VideoTexture video_texture;
+    video_texture_init(&video_texture, render);
+    // swscale 路径(非直接上传的格式, 或缩小到窗口尺寸)按行分带多线程转换
+    video_texture_set_threads(&video_texture, av_cpu_count());
+    // 按窗口的实际像素尺寸缩放, 窗口大小变化时重新设置; 空输出按窗口的默认尺寸, 转换量与有窗口时相同
+    int output_w = pCodecCtx->width / 2;
+    int output_h = pCodecCtx->height / 2;
+    if (render) {
+        SDL_GetRendererOutputSize(render, &output_w, &output_h);
     }
+    video_texture_set_size(&video_texture, output_w, output_h);
     SDL_Event event;
-    // 即使我们已经创建好帧了, 当我们在转换过程中时, 仍然需要一个地方保存原始(Raw)数据.
-    // 我们使用avpicture_get_size 去获取我们需要的buffer大小.
-    uint8_t* buffer = NULL;
-    int numBytes;
-
-    // numBytes = avpicture_get_size(AV_PIX_FMT_RGB24, pCodecCtx->width, pCodecCtx->height);
-    numBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, pCodecCtx->width, pCodecCtx->height, 32);
-    buffer = (uint8_t*)av_malloc(numBytes*sizeof(uint8_t));
-
-    // 填充RGB帧 -> 将缓冲区与pFrameRGB 关联.
-    // avpicture_fill((AVPicture*)pFrameRGB, buffer, AV_PIX_FMT_YUV420P, pCodecCtx->width, pCodecCtx->height);
-    av_image_fill_arrays(pFrameRGB->data, pFrameRGB->linesize, buffer, AV_PIX_FMT_YUV420P, pCodecCtx->width, pCodecCtx->height, 32);
-
-    // 初始化缩放上下文
 
     // 终于, 我们现在可以从流中读取数据.
-    // 接下来我们要做的就是把一整个视频流从包(packet)中读取出来, 解码到我们得帧, 然后只要帧完毕, 我们就会转化它并且保存它.
-    struct SwsContext* sws_ctx = NULL;
+    // 接下来我们要做的就是把一整个视频流从包(packet)中读取出来, 解码到我们得帧, 然后只要帧完毕, 我们就会上传并显示它.
     AVPacket* pPacket = av_packet_alloc();
     if (pPacket == NULL) {
         printf("av_packet_alloc failed\n");
         return -1;
     }
-    // 创建一个缩放的上下文
-    sws_ctx = sws_getContext(
-        pCodecCtx->width, pCodecCtx->height,
-        pCodecCtx->pix_fmt,
-        pCodecCtx->width, pCodecCtx->height,
-        AV_PIX_FMT_YUV420P,
-        SWS_BILINEAR, NULL, NULL, NULL
-    );
 
     int maxFramesToDecode;
     sscanf(argv[2], "%d", &maxFramesToDecode);
+
+    // 按帧的pts安排显示时间, 而不是固定 SDL_Delay(1000/r_frame_rate):
+    // 第一帧显示时记录单调时钟和pts作为基准, 之后每帧的目标时间 = 基准时间 + (pts - 基准pts),
+    // 只睡剩下的时间, 解码/缩放/渲染已经花掉的时间不会重复等待.
+    AVRational time_base = pFormatCtx->streams[videoStream]->time_base;
+    int64_t frame_duration = av_rescale_q(1, av_inv_q(pFormatCtx->streams[videoStream]->r_frame_rate), AV_TIME_BASE_Q);
+    int64_t base_time = AV_NOPTS_VALUE;
+    int64_t base_pts = 0;
+    int64_t target_time = 0;
+    // 晚到帧的统计
+    int nb_late = 0;
+    int64_t total_late = 0;
+    int64_t max_late = 0;
+    int64_t start_time = av_gettime_relative();
+    int nb_shown = 0;
     // 读取和解码帧
     i = 0;
     while (av_read_frame(pFormatCtx, pPacket) >= 0) {
@@ -182,32 +227,47 @@ int main(int argc, char* argv[]) {
                     printf("avcodec_receive_frame failed\n");
                     return -1;
                 }
-                // 缩放帧
-                sws_scale(sws_ctx, (uint8_t const* const*)pFrame->data, pFrame->linesize, 0, pCodecCtx->height, pFrameRGB->data, pFrameRGB->linesize);
                 if (++i <= maxFramesToDecode) {
-                    double fps = av_q2d(pFormatCtx->streams[videoStream]->r_frame_rate);
-                    double sleep_time = 1.0 / (double) fps;
-                    SDL_Delay((1000*sleep_time)-10);
-
-                    SDL_Rect rect;
-                    rect.x = 0;
-                    rect.y = 0;
-                    rect.w = pCodecCtx->width;
-                    rect.h = pCodecCtx->height;
-                    SDL_UpdateYUVTexture(
-                        texture, &rect,
-                        pFrameRGB->data[0], pFrameRGB->linesize[0], // Y
-                        pFrameRGB->data[1], pFrameRGB->linesize[1], // U
-                        pFrameRGB->data[2], pFrameRGB->linesize[2] // V
-                    );
-                    SDL_RenderClear(render);
-                    SDL_RenderCopy(
-                        render,
-                        texture,
-                        NULL,
-                        NULL
-                    );
-                    SDL_RenderPresent(render);
+                    int64_t pts = pFrame->best_effort_timestamp;
+                    if (base_time == AV_NOPTS_VALUE) {
+                        base_time = av_gettime_relative();
+                        base_pts = pts != AV_NOPTS_VALUE ? av_rescale_q(pts, time_base, AV_TIME_BASE_Q) : 0;
+                        target_time = base_time;
+                    } else if (pts != AV_NOPTS_VALUE) {
+                        target_time = base_time + av_rescale_q(pts, time_base, AV_TIME_BASE_Q) - base_pts;
+                    } else {
+                        // 没有时间戳时按帧率往后推一帧
+                        target_time += frame_duration;
+                    }
+                    int64_t now = av_gettime_relative();
+                    if (fast) {
+                        // 全速: 不等待, 也不算晚到
+                    } else if (now < target_time) {
+                        av_usleep(target_time - now);
+                    } else if (now - target_time >= 1000) {
+                        int64_t late = now - target_time;
+                        nb_late++;
+                        total_late += late;
+                        if (late > max_late) {
+                            max_late = late;
+                        }
+                        printf("frame %d late by %lld ms\n", i, (long long)(late / 1000));
+                    }
+
+                    if (video_texture_upload(&video_texture, pFrame) < 0) {
+                        return -1;
+                    }
+                    if (render) {
+                        SDL_RenderClear(render);
+                        SDL_RenderCopy(
+                            render,
+                            video_texture.texture,
+                            NULL,
+                            NULL
+                        );
+                        SDL_RenderPresent(render);
+                    }
+                    nb_shown++;
                 } else {
                     break;
                 }
@@ -218,20 +278,32 @@ int main(int argc, char* argv[]) {
         }
         av_packet_unref(pPacket);
 
-        SDL_PollEvent(&event);
-        switch (event.type) {
-            case SDL_QUIT: {
-                SDL_Quit();
-                exit(0);
+        while (!null_video && SDL_PollEvent(&event)) {
+            switch (event.type) {
+                case SDL_QUIT: {
+                    SDL_Quit();
+                    exit(0);
+                }
+                    break;
+                case SDL_WINDOWEVENT:
+                    if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                        SDL_GetRendererOutputSize(render, &output_w, &output_h);
+                        video_texture_set_size(&video_texture, output_w, output_h);
+                    }
+                    break;
             }
-                break;
         }
     }
+    int64_t elapsed = av_gettime_relative() - start_time;
+    printf("%d frames in %.1f ms (%.1f fps)%s\n", nb_shown, elapsed / 1000.0,
+        elapsed > 0 ? nb_shown * 1000000.0 / elapsed : 0.0, fast ? ", not paced" : "");
+    printf("%d frames late, avg %.1f ms, max %.1f ms\n",
+        nb_late, nb_late > 0 ? total_late / 1000.0 / nb_late : 0.0, max_late / 1000.0);
+    video_texture_print_stats(&video_texture);
+    frame_allocator_print_stats(&frame_allocator);
+    mmap_input_print_stats(&input);
     // cleanup:
-    // Free RGB image
-    av_free(buffer);
-    av_frame_free(&pFrameRGB);
-    av_free(pFrameRGB);
+    video_texture_free(&video_texture);
     // Free YUV frame
     av_frame_free(&pFrame);
     av_free(pFrame);
@@ -239,15 +311,26 @@ int main(int argc, char* argv[]) {
     // Close the codecs
     avcodec_close(pCodecCtx);
     avcodec_close(pCodecCtxOrig);
+    frame_allocator_destroy(&frame_allocator);
 
     avformat_close_input(&pFormatCtx);
+    mmap_input_close(&input);
 
     return 0;
 }
 
 void printHelpMenu() {
     printf("Invalid arguments.\n\n");
-    printf("Usage: ./program <filename> <max-frames-to-decode>\n\n");
+    printf("Usage: ./program <filename> <max-frames-to-decode> [--threads N] [--thread-type auto|frame|slice|both]"
+           " [--null-video] [--fast]\n"
+           "       [--frame-buffers default|pool|huge] [--mmap]\n\n");
+    printf("  --threads N  decoder threads, 0 (default) picks from the number of cores\n");
+    printf("  --thread-type auto|frame|slice|both  decoder threading, auto (default) lets the codec choose\n");
+    printf("  --null-video  no window: frames are converted into memory and discarded\n");
+    printf("  --fast  do not wait for each frame's pts, run as fast as decoding allows\n");
+    printf("  --frame-buffers default|pool|huge  decoded frame buffers: libavcodec's own, aligned size-class\n"
+           "                    pools (default), or pools backed by transparent huge pages\n");
+    printf("  --mmap  read the input through a memory mapping instead of read() calls\n\n");
     printf(
         "e.g: ./program /home/rambodrahmani/Videos/Labrinth-Jealous.mp4 "
         "200\n");
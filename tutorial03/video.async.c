@@ -5,34 +5,118 @@
 #include <libavformat/avformat.h>
 #include <libavutil/imgutils.h>
 #include <libavutil/opt.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
 #include <libswresample/swresample.h>
 #include <libswscale/swscale.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "decoder_threads.h"
+#include "frame_allocator.h"
+#include "frame_queue.h"
+#include "media_pool.h"
+#include "mmap_input.h"
+#include "packet_queue.h"
+#include "prefetch_input.h"
+#include "pcm_ring.h"
+#include "resampler.h"
+#include "stage_stats.h"
+#include "video_texture.h"
+
 #define SDL_AUDIO_BUFFER_SIZE 1024
 // 一般设置音频最大缓存大小方案: (48khz) * 2(16bit) * 2channel = 192000
 #define MAX_AUDIO_FRAME_SIZE 192000
-
-typedef struct PacketQueue {
-    AVPacketList* first_pkt;
-    AVPacketList* last_pkt;
-    int nb_packets;
-    int size;
-    SDL_mutex* mutex;
-    SDL_cond* cond;
-} PacketQueue;
+// audioq 的背压上限: 字节数 / 时长(ms), 超过后demux循环阻塞在 packet_queue_put
+#define AUDIOQ_MAX_SIZE (512 * 1024)
+#define AUDIOQ_MAX_DURATION_MS 2000
+// 解码线程提前解码的PCM缓冲大小, 约1秒 48khz 16bit 双声道
+#define AUDIO_RING_SIZE MAX_AUDIO_FRAME_SIZE
+// videoq 的背压上限
+#define VIDEOQ_MAX_SIZE (8 * 1024 * 1024)
+#define VIDEOQ_MAX_DURATION_MS 2000
+// 解码好等待渲染的帧数
+#define VIDEO_PICTURE_QUEUE_SIZE 4
+// 音视频同步阈值(us): 视频比音频早超过 AV_SYNC_THRESHOLD 就等待, 晚超过 AV_LATE_THRESHOLD 就丢帧;
+// 差值超过 AV_NOSYNC_THRESHOLD 认为时间戳不可信, 不做同步直接显示
+#define AV_SYNC_THRESHOLD 10000
+#define AV_LATE_THRESHOLD 40000
+#define AV_NOSYNC_THRESHOLD 10000000
+// 早到的帧每次最多等待的时间, 保证事件能及时处理
+#define REFRESH_MAX_WAIT_US 10000
+// pictq 空着等待超过这个时间(us)算一次卡顿
+#define VIDEO_STALL_THRESHOLD_US 100000
+
+// 以音频为主时钟: 时钟 = 第一帧音频pts + 音频回调已经取走的字节数 / 每秒字节数,
+// 再减去还在声卡缓冲里没播出去的部分, 加上距上次回调过去的时间.
+typedef struct AudioClock {
+    // 第一个带pts的音频帧的pts(us), AV_NOPTS_VALUE 表示还没有
+    atomic_llong start_pts;
+    // 该帧数据在 audio_ring 中的起始字节位置
+    int64_t start_bytes;
+    int bytes_per_sec;
+    // 声卡一次回调的缓冲字节数(spec.size)
+    int hw_buf_size;
+    // 上一次回调结束时 audio_ring 的读位置和当时的时间
+    atomic_llong consumed_bytes;
+    atomic_llong callback_time;
+} AudioClock;
+
+// 视频相对音频时钟的偏移统计
+typedef struct AVSyncStats {
+    int64_t nb_frames;
+    int64_t sum_abs_offset;
+    int64_t max_abs_offset;
+    int64_t last_offset;
+    int nb_dropped;
+    int nb_delayed;
+} AVSyncStats;
+
+// 视频输出端等待 pictq 的统计
+typedef struct VideoSinkStats {
+    int64_t nb_frames;
+    int nb_stalls;
+    int64_t max_stall;
+    int64_t total_stall;
+} VideoSinkStats;
+
+typedef struct DemuxContext {
+    AVFormatContext* pFormatCtx;
+    int videoStream;
+    int audioStream;
+} DemuxContext;
 
 PacketQueue audioq;
+PacketQueue videoq;
+FrameQueue pictq;
+PcmRing audio_ring;
+AudioResampler audio_resampler;
+// 每条流一个 packet/frame 池, demux 线程读包用视频流的池
+MediaPool audio_pool;
+MediaPool video_pool;
+StageStats demux_stats;
+StageStats video_decode_stats;
+StageStats render_stats;
+atomic_int video_finished;
+AudioClock audio_clock;
+AVSyncStats av_sync_stats;
+VideoSinkStats video_sink_stats;
+// 无界面运行: null_audio 用线程代替声卡回调, null_video 不开窗口; fast 时都不按时钟等待
+int null_audio = 0;
+int null_video = 0;
+int fast = 0;
 int quit = 0;
 
-void packet_queue_init(PacketQueue* q);
-int packet_queue_put(PacketQueue* q, AVPacket* packet);
-static int packet_queue_get(PacketQueue* q, AVPacket* packet, int block);
 void audio_callback(void* userdata, Uint8* stream, int len);
+int audio_decode_thread(void* arg);
+int null_audio_thread(void* arg);
+int demux_thread(void* arg);
+int video_decode_thread(void* arg);
+int64_t audio_clock_get(AudioClock* clock);
 int audio_decode_frame(AVCodecContext* aCodecContext, uint8_t* audio_buf, int buf_size);
+static int audio_decode_packets(AVCodecContext* aCodecCtx, AVFrame* avFrame, uint8_t* audio_buf, int buf_size);
 static int audio_resampling(
-    AVCodecContext* audio_decode_ctx,
     AVFrame* audio_decode_frame,
     enum AVSampleFormat out_sample_fmt,
     int out_channels, int out_sample_rate,
@@ -43,10 +127,60 @@ int main(int argc, char* argv[]) {
     if(argc < 2) {
         return -1;
     }
+    // 解码线程策略: video <file> [--threads N] [--thread-type auto|frame|slice|both]
+    // 无界面运行: [--null-video] [--null-audio] [--fast], --fast 需要 --null-audio(否则由声卡决定速度)
+    // 视频帧缓冲区: [--frame-buffers default|pool|huge]; 输入文件 mmap 后读: [--mmap]
+    // 慢存储: [--prefetch MB] 预读线程把输入读进 MB 大小的缓冲区, demux 只从内存读
+    DecoderThreads decoder_threads;
+    decoder_threads_init(&decoder_threads);
+    int frame_buffers = FRAME_BUFFERS_POOL;
+    int use_mmap = 0;
+    int prefetch_mb = 0;
+    for (int arg = 2; arg < argc; arg++) {
+        int ok = 0;
+        if (arg + 1 < argc && strcmp(argv[arg], "--threads") == 0) {
+            ok = sscanf(argv[++arg], "%d", &decoder_threads.count) == 1;
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--thread-type") == 0) {
+            ok = decoder_threads_parse_type(&decoder_threads, argv[++arg]) == 0;
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--frame-buffers") == 0) {
+            frame_buffers = frame_allocator_parse_mode(argv[++arg]);
+            ok = frame_buffers >= 0;
+        } else if (strcmp(argv[arg], "--null-video") == 0) {
+            ok = null_video = 1;
+        } else if (strcmp(argv[arg], "--null-audio") == 0) {
+            ok = null_audio = 1;
+        } else if (strcmp(argv[arg], "--fast") == 0) {
+            ok = fast = 1;
+        } else if (strcmp(argv[arg], "--mmap") == 0) {
+            ok = use_mmap = 1;
+        } else if (arg + 1 < argc && strcmp(argv[arg], "--prefetch") == 0) {
+            ok = sscanf(argv[++arg], "%d", &prefetch_mb) == 1 && prefetch_mb > 0;
+        }
+        if (!ok) {
+            printf("Usage: %s <file> [--threads N] [--thread-type auto|frame|slice|both]"
+                   " [--null-video] [--null-audio] [--fast] [--frame-buffers default|pool|huge]"
+                   " [--mmap] [--prefetch MB]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (fast && !null_audio) {
+        printf("--fast needs --null-audio\n");
+        return -1;
+    }
+    if (use_mmap && prefetch_mb > 0) {
+        printf("--mmap and --prefetch cannot be used together\n");
+        return -1;
+    }
 
     int ret = -1;
     AVFormatContext* pFormatCtx = NULL;
-    ret = avformat_open_input(&pFormatCtx, argv[1], NULL, NULL);
+    MmapInput input;
+    PrefetchInput prefetch;
+    if (prefetch_mb > 0) {
+        ret = prefetch_input_open(&prefetch, argv[1], prefetch_mb, &pFormatCtx);
+    } else {
+        ret = mmap_input_open(&input, argv[1], use_mmap, &pFormatCtx);
+    }
     if (ret < 0) {
         printf("Could not open source file %s\n", argv[1]);
         return -1;
@@ -58,7 +192,7 @@ int main(int argc, char* argv[]) {
     }
     av_dump_format(pFormatCtx, 0, argv[1], 0);
     int videoStream = -1, audioStream = -1;
-    for (int i = 0; i < pFormatCtx->nb_streams; i++) {
+    for (int i = 0; i < (int)pFormatCtx->nb_streams; i++) {
         if (pFormatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && videoStream < 0) {
             videoStream = i;
         }
@@ -85,15 +219,32 @@ int main(int argc, char* argv[]) {
         printf("Could not copy codec parameters to decoder context\n");
         return -1;
     }
+    // 解码出的帧pts以流的time_base为单位, 音频时钟需要用到
+    aCodecCtx->pkt_timebase = pFormatCtx->streams[audioStream]->time_base;
 
     // 打开解码器
     // 初始化音频的AVCodecContext 去使用对应的解码器
+    decoder_threads_apply(&decoder_threads, aCodecCtx);
     ret = avcodec_open2(aCodecCtx, aCodec, NULL);
     if (ret < 0) {
         printf("Could not open codec\n");
         return -1;
     }
-    packet_queue_init(&audioq);
+    decoder_threads_print(aCodecCtx, "audio");
+    if (packet_queue_init(&audioq, PACKET_QUEUE_DEFAULT_CAPACITY) < 0) {
+        return -1;
+    }
+    packet_queue_set_limits(&audioq, AUDIOQ_MAX_SIZE, AUDIOQ_MAX_DURATION_MS * 1000LL,
+        pFormatCtx->streams[audioStream]->time_base);
+    audio_resampler_init(&audio_resampler);
+    if (pcm_ring_init(&audio_ring, AUDIO_RING_SIZE) < 0) {
+        return -1;
+    }
+    // 音频解码线程同时只用一个包和一个帧; 视频是 demux 和视频解码线程各一个包, 解码线程一个帧
+    if (media_pool_init(&audio_pool, "audio", 2, 2) < 0 || media_pool_init(&video_pool, "video", 3, 2) < 0) {
+        return -1;
+    }
+    atomic_init(&audio_clock.start_pts, AV_NOPTS_VALUE);
 
     AVCodec* pCodec = avcodec_find_decoder(pFormatCtx->streams[videoStream]->codecpar->codec_id);
     AVCodecContext* pCodecCtx = avcodec_alloc_context3(pCodec);
@@ -103,11 +254,22 @@ int main(int argc, char* argv[]) {
         printf("Could not copy codec parameters to decoder context\n");
         return -1;
     }
-    // 使用上下文打开解码器
+    // 使用上下文打开解码器; 帧级多线程会让输出多延迟几帧, 由 pictq 和音视频同步吸收.
+    // 视频帧从 frame_allocator 的缓冲池分配, 音频帧小, 仍用默认的
+    FrameAllocator frame_allocator;
+    if (frame_allocator_init(&frame_allocator, frame_buffers) < 0) {
+        return -1;
+    }
+    frame_allocator_attach(&frame_allocator, pCodecCtx);
+    decoder_threads_apply(&decoder_threads, pCodecCtx);
     ret = avcodec_open2(pCodecCtx, pCodec, NULL);
-    AVFrame* pFrame = av_frame_alloc();
+    if (ret < 0) {
+        printf("Could not open codec\n");
+        return -1;
+    }
+    decoder_threads_print(pCodecCtx, "video");
 
-    ret = SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER);
+    ret = SDL_Init((null_video ? 0 : SDL_INIT_VIDEO) | (null_audio ? 0 : SDL_INIT_AUDIO) | SDL_INIT_TIMER);
     if (ret < 0) {
         printf("Could not initialize SDL - %s\n", SDL_GetError());
         return -1;
@@ -121,251 +283,451 @@ int main(int argc, char* argv[]) {
     wanted_specs.silence = 0;
     wanted_specs.samples = SDL_AUDIO_BUFFER_SIZE;
     wanted_specs.callback = audio_callback;
-    wanted_specs.userdata = aCodecCtx;
+    wanted_specs.userdata = &audio_ring;
 
-    SDL_AudioDeviceID audioDeviceID = SDL_OpenAudioDevice(NULL, 0, &wanted_specs, &specs, SDL_AUDIO_ALLOW_FORMAT_CHANGE);
-    if (audioDeviceID == 0) {
-        printf("Could not open audio device - %s\n", SDL_GetError());
+    SDL_AudioDeviceID audioDeviceID = 0;
+    if (null_audio) {
+        // 空输出直接用请求的参数(S16), 每次回调取 samples 个采样
+        specs = wanted_specs;
+        specs.size = specs.samples * specs.channels * 2;
+    } else {
+        audioDeviceID = SDL_OpenAudioDevice(NULL, 0, &wanted_specs, &specs, SDL_AUDIO_ALLOW_FORMAT_CHANGE);
+        if (audioDeviceID == 0) {
+            printf("Could not open audio device - %s\n", SDL_GetError());
+            return -1;
+        }
+    }
+    audio_clock.hw_buf_size = specs.size;
+    SDL_Thread* audioDecodeThread = SDL_CreateThread(audio_decode_thread, "audio_decode", aCodecCtx);
+    if (!audioDecodeThread) {
+        printf("Could not create audio decode thread - %s\n", SDL_GetError());
         return -1;
     }
-    SDL_PauseAudioDevice(audioDeviceID, 0);
+    SDL_Thread* nullAudioThread = NULL;
+    if (null_audio) {
+        nullAudioThread = SDL_CreateThread(null_audio_thread, "null_audio", &specs);
+        if (!nullAudioThread) {
+            printf("Could not create null audio thread - %s\n", SDL_GetError());
+            return -1;
+        }
+    } else {
+        SDL_PauseAudioDevice(audioDeviceID, 0);
+    }
 
     // Graphic
-    SDL_Window* screen = SDL_CreateWindow("FFMPEG", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-        pCodecCtx->width/4, pCodecCtx->height/4, SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI);
-    if (!screen) {
-        puts("SDL_CreateWindow failed!");
+    SDL_Window* screen = NULL;
+    SDL_Renderer* renderer = NULL;
+    if (!null_video) {
+        screen = SDL_CreateWindow("FFMPEG", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+            pCodecCtx->width/4, pCodecCtx->height/4, SDL_WINDOW_OPENGL | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE);
+        if (!screen) {
+            puts("SDL_CreateWindow failed!");
+            return -1;
+        }
+        SDL_GL_SetSwapInterval(1);
+        renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
+    }
+    // 解码器输出 YUV420P/NV12/NV21 时直接上传帧的平面, 其他格式才经过swscale
+    VideoTexture video_texture;
+    video_texture_init(&video_texture, renderer);
+    // swscale 路径(非直接上传的格式, 或缩小到窗口尺寸)按行分带多线程转换
+    video_texture_set_threads(&video_texture, av_cpu_count());
+    // 按窗口的实际像素尺寸缩放, 窗口大小变化时重新设置; 空输出按窗口的默认尺寸, 转换量与有窗口时相同
+    int output_w = pCodecCtx->width / 4;
+    int output_h = pCodecCtx->height / 4;
+    if (renderer) {
+        SDL_GetRendererOutputSize(renderer, &output_w, &output_h);
+    }
+    video_texture_set_size(&video_texture, output_w, output_h);
+
+    // 流水线: demux线程 -> videoq -> 视频解码线程 -> pictq -> 主线程渲染
+    //                  \-> audioq -> 音频解码线程 -> audio_ring -> 音频回调
+    if (packet_queue_init(&videoq, PACKET_QUEUE_DEFAULT_CAPACITY) < 0) {
         return -1;
     }
-    SDL_GL_SetSwapInterval(1);
-    SDL_Renderer* renderer = SDL_CreateRenderer(screen, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
-    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_YV12, SDL_TEXTUREACCESS_STREAMING, pCodecCtx->width, pCodecCtx->height);
-    struct SwsContext* sws_ctx = sws_getContext(pCodecCtx->width, pCodecCtx->height, pCodecCtx->pix_fmt, pCodecCtx->width, pCodecCtx->height, AV_PIX_FMT_YUV420P, SWS_BILINEAR, NULL, NULL, NULL);
-    int numBytes = av_image_get_buffer_size(AV_PIX_FMT_YUV420P, pCodecCtx->width, pCodecCtx->height, 32);
-    uint8_t* buffer = (uint8_t*)av_malloc(numBytes*sizeof(uint8_t));
-    // 这个frame用于保存video解码后的帧
-    AVFrame* pict = av_frame_alloc();
-    // 将buffer缓冲区与pict帧关联
-    av_image_fill_arrays(pict->data, pict->linesize, buffer, AV_PIX_FMT_YUV420P, pCodecCtx->width, pCodecCtx->height, 32);
-
-    AVPacket* pPacket = av_packet_alloc();
-    if (!pPacket) {
-        printf("Could not allocate AVPacket\n");
+    packet_queue_set_limits(&videoq, VIDEOQ_MAX_SIZE, VIDEOQ_MAX_DURATION_MS * 1000LL,
+        pFormatCtx->streams[videoStream]->time_base);
+    if (frame_queue_init(&pictq, VIDEO_PICTURE_QUEUE_SIZE) < 0) {
+        return -1;
+    }
+    stage_stats_init(&demux_stats, "demux");
+    stage_stats_init(&video_decode_stats, "video decode");
+    stage_stats_init(&render_stats, "render");
+
+    DemuxContext demux;
+    demux.pFormatCtx = pFormatCtx;
+    demux.videoStream = videoStream;
+    demux.audioStream = audioStream;
+    SDL_Thread* demuxThread = SDL_CreateThread(demux_thread, "demux", &demux);
+    SDL_Thread* videoDecodeThread = SDL_CreateThread(video_decode_thread, "video_decode", pCodecCtx);
+    if (!demuxThread || !videoDecodeThread) {
+        printf("Could not create thread - %s\n", SDL_GetError());
         return -1;
     }
+
+    // 主线程只做渲染: 取已经解码好的帧, 按音频时钟转换并上传纹理
+    AVRational video_time_base = pFormatCtx->streams[videoStream]->time_base;
+    int64_t delayed_pts = AV_NOPTS_VALUE;
+    int64_t sink_start = av_gettime_relative();
+    int64_t stall_start = AV_NOPTS_VALUE;
     SDL_Event event;
-    while (av_read_frame(pFormatCtx, pPacket) >= 0) {
-        if (pPacket->stream_index == videoStream) {
-            // 使用pPacket接收一个包的数据
-            ret = avcodec_send_packet(pCodecCtx, pPacket);
-            if (ret < 0) {
-                printf("avcodec_send_packet error\n");
-                return -1;
-            }
-            while (ret >= 0) {
-                // 从pPacket包中接收其中一个帧的数据放进pFrame中
-                ret = avcodec_receive_frame(pCodecCtx, pFrame);
-                if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+    while (!quit) {
+        while (!null_video && SDL_PollEvent(&event)) {
+            switch (event.type) {
+                case SDL_QUIT:
+                    printf("Quit\n");
+                    quit = 1;
+                    break;
+                case SDL_KEYDOWN:
+                    if (event.key.keysym.sym == SDLK_SPACE) {
+                        printf("Quit\n");
+                        quit = 1;
+                    }
+                    break;
+                case SDL_WINDOWEVENT:
+                    if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+                        SDL_GetRendererOutputSize(renderer, &output_w, &output_h);
+                        video_texture_set_size(&video_texture, output_w, output_h);
+                    }
                     break;
-                } else if (ret < 0) {
-                    puts("avcodec_receive_frame error");
-                    return -1;
-                }
-                sws_scale(sws_ctx, (uint8_t const* const*)pFrame->data, pFrame->linesize, 0, pCodecCtx->height, pict->data, pict->linesize);
-                SDL_Rect rect;
-                rect.x = 0; rect.y = 0; rect.w = pCodecCtx->width; rect.h = pCodecCtx->height;
-                SDL_UpdateYUVTexture(texture, &rect,
-                    pict->data[0], pict->linesize[0], pict->data[1], pict->linesize[1], pict->data[2], pict->linesize[2]);
-                SDL_RenderClear(renderer);
-                SDL_RenderCopy(renderer, texture, NULL, NULL);
-                SDL_RenderPresent(renderer);
             }
-        } else {
-            av_packet_unref(pPacket);
         }
-        SDL_PollEvent(&event);
-        switch (event.type) {
-            case SDL_QUIT: {
-                printf("Quit\n");
-                SDL_Quit();
-                quit = 1;
-            }
+        if (quit) {
+            break;
+        }
+        AVFrame* frame = frame_queue_peek(&pictq, 10);
+        if (!frame) {
+            // 解码线程已结束且没有剩余帧, 视频播放完毕
+            if (atomic_load(&video_finished) && frame_queue_nb_remaining(&pictq) == 0) {
                 break;
-            case SDL_KEYDOWN:
-                if (event.key.keysym.sym == SDLK_SPACE) {
-                    printf("Quit\n");
-                    SDL_Quit();
-                    quit = 1;
+            }
+            if (stall_start == AV_NOPTS_VALUE) {
+                stall_start = av_gettime_relative();
+            }
+            continue;
+        }
+        if (stall_start != AV_NOPTS_VALUE) {
+            // pictq 空了多久: 解码跟不上输出
+            int64_t stall = av_gettime_relative() - stall_start;
+            stall_start = AV_NOPTS_VALUE;
+            if (stall >= VIDEO_STALL_THRESHOLD_US && video_sink_stats.nb_frames > 0) {
+                video_sink_stats.nb_stalls++;
+                video_sink_stats.total_stall += stall;
+                video_sink_stats.max_stall = FFMAX(video_sink_stats.max_stall, stall);
+            }
+        }
+        // 按音频时钟安排显示时间: 早到的帧等待, 晚到太多的帧(且后面还有帧)直接丢弃;
+        // fast 时空音频输出不按时间走, 每帧都照常转换上传, 不做同步
+        int64_t offset = AV_NOPTS_VALUE;
+        int64_t master_clock = fast ? AV_NOPTS_VALUE : audio_clock_get(&audio_clock);
+        if (frame->best_effort_timestamp != AV_NOPTS_VALUE && master_clock != AV_NOPTS_VALUE) {
+            int64_t frame_pts = av_rescale_q(frame->best_effort_timestamp, video_time_base, AV_TIME_BASE_Q);
+            offset = frame_pts - master_clock;
+            if (offset > -AV_NOSYNC_THRESHOLD && offset < AV_NOSYNC_THRESHOLD) {
+                if (offset > AV_SYNC_THRESHOLD) {
+                    if (frame->best_effort_timestamp != delayed_pts) {
+                        delayed_pts = frame->best_effort_timestamp;
+                        av_sync_stats.nb_delayed++;
+                    }
+                    // 还没到时间: 睡一小段后回到循环开头处理事件再检查
+                    av_usleep(FFMIN(offset, REFRESH_MAX_WAIT_US));
+                    continue;
+                } else if (offset < -AV_LATE_THRESHOLD && frame_queue_nb_remaining(&pictq) > 1) {
+                    av_sync_stats.nb_dropped++;
+                    frame_queue_next(&pictq);
+                    continue;
                 }
-                break;
+            } else {
+                offset = AV_NOPTS_VALUE;
+            }
         }
-        if (quit) {
+        int64_t start = av_gettime_relative();
+        if (video_texture_upload(&video_texture, frame) < 0) {
+            quit = 1;
             break;
         }
+        if (renderer) {
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, video_texture.texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+        }
+        stage_stats_add(&render_stats, 1, av_gettime_relative() - start);
+        video_sink_stats.nb_frames++;
+        if (offset != AV_NOPTS_VALUE) {
+            // 以真正显示时的时钟计算偏移
+            master_clock = audio_clock_get(&audio_clock);
+            if (master_clock != AV_NOPTS_VALUE) {
+                offset = av_rescale_q(frame->best_effort_timestamp, video_time_base, AV_TIME_BASE_Q) - master_clock;
+                int64_t abs_offset = offset < 0 ? -offset : offset;
+                av_sync_stats.nb_frames++;
+                av_sync_stats.sum_abs_offset += abs_offset;
+                av_sync_stats.max_abs_offset = FFMAX(av_sync_stats.max_abs_offset, abs_offset);
+                av_sync_stats.last_offset = offset;
+            }
+        }
+        frame_queue_next(&pictq);
     }
-    av_packet_unref(pPacket);
-
-    // Free RGB image
-    av_free(buffer);
-    av_frame_free(&pict);
-    av_free(pict);
-    // Free YUV frame
-    av_frame_free(&pFrame);
-    av_free(pFrame);
-
+    int64_t sink_elapsed = av_gettime_relative() - sink_start;
+    // 视频结束后等剩余的音频播放完
+    while (!quit && (atomic_load(&audioq.nb_packets) > 0 || pcm_ring_fill(&audio_ring) > 0)) {
+        while (!null_video && SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                quit = 1;
+            }
+        }
+        SDL_Delay(10);
+    }
+    // 先唤醒阻塞在队列/缓冲区上的各个线程, 再关闭设备
+    quit = 1;
+    packet_queue_abort(&videoq);
+    packet_queue_abort(&audioq);
+    frame_queue_abort(&pictq);
+    pcm_ring_abort(&audio_ring);
+    SDL_WaitThread(demuxThread, NULL);
+    SDL_WaitThread(videoDecodeThread, NULL);
+    SDL_WaitThread(audioDecodeThread, NULL);
+    if (nullAudioThread) {
+        SDL_WaitThread(nullAudioThread, NULL);
+    } else {
+        SDL_CloseAudioDevice(audioDeviceID);
+    }
+    stage_stats_print(&demux_stats);
+    stage_stats_print(&video_decode_stats);
+    stage_stats_print(&render_stats);
+    video_texture_print_stats(&video_texture);
+    media_pool_print_stats(&audio_pool);
+    media_pool_print_stats(&video_pool);
+    frame_allocator_print_stats(&frame_allocator);
+    if (prefetch_mb > 0) {
+        prefetch_input_print_stats(&prefetch);
+    } else {
+        mmap_input_print_stats(&input);
+    }
+    printf("video sink: %lld frames in %.1f ms (%.1f fps), %d stalls over %d ms (total %.1f ms, max %.1f ms)\n",
+        (long long)video_sink_stats.nb_frames, sink_elapsed / 1000.0,
+        sink_elapsed > 0 ? video_sink_stats.nb_frames * 1000000.0 / sink_elapsed : 0.0,
+        video_sink_stats.nb_stalls, VIDEO_STALL_THRESHOLD_US / 1000,
+        video_sink_stats.total_stall / 1000.0, video_sink_stats.max_stall / 1000.0);
+    printf("A/V offset: avg %.1f ms, max %.1f ms, last %.1f ms over %lld frames; %d dropped, %d delayed\n",
+        av_sync_stats.nb_frames > 0 ? av_sync_stats.sum_abs_offset / 1000.0 / av_sync_stats.nb_frames : 0.0,
+        av_sync_stats.max_abs_offset / 1000.0, av_sync_stats.last_offset / 1000.0,
+        (long long)av_sync_stats.nb_frames, av_sync_stats.nb_dropped, av_sync_stats.nb_delayed);
+    printf("audio ring: %u/%u bytes buffered, %d underruns (%lld bytes of silence)\n",
+        pcm_ring_fill(&audio_ring), audio_ring.capacity,
+        atomic_load(&audio_ring.underruns), (long long)atomic_load(&audio_ring.underrun_bytes));
+    packet_queue_destroy(&videoq);
+    packet_queue_destroy(&audioq);
+    frame_queue_destroy(&pictq);
+    pcm_ring_destroy(&audio_ring);
+    media_pool_destroy(&audio_pool);
+    media_pool_destroy(&video_pool);
+
+    video_texture_free(&video_texture);
+
+    audio_resampler_free(&audio_resampler);
     avcodec_close(pCodecCtx);
     avcodec_close(aCodecCtx);
+    frame_allocator_destroy(&frame_allocator);
 
     avformat_close_input(&pFormatCtx);
+    if (prefetch_mb > 0) {
+        prefetch_input_close(&prefetch);
+    } else {
+        mmap_input_close(&input);
+    }
+    SDL_Quit();
     return 0;
 }
 
-void packet_queue_init(PacketQueue* q) {
-    memset(q, 0, sizeof(PacketQueue));
-    q->mutex = SDL_CreateMutex();
-    if (!q->mutex) {
-        printf("SDL_CreateMutex error\n");
-        return;
+int demux_thread(void* arg) {
+    DemuxContext* demux = (DemuxContext*)arg;
+    AVPacket* pPacket = media_pool_get_packet(&video_pool);
+    if (!pPacket) {
+        printf("Could not allocate AVPacket\n");
+        return -1;
     }
-    q->cond = SDL_CreateCond();
-    if (!q->cond) {
-        printf("SDL_CreateCond error\n");
-        return;
+    while (!quit) {
+        int64_t start = av_gettime_relative();
+        if (av_read_frame(demux->pFormatCtx, pPacket) < 0) {
+            break;
+        }
+        stage_stats_add(&demux_stats, 1, av_gettime_relative() - start);
+        // videoq/audioq 满时在这里阻塞, 由对应的解码线程消费后唤醒
+        if (pPacket->stream_index == demux->videoStream) {
+            packet_queue_put(&videoq, pPacket);
+        } else if (pPacket->stream_index == demux->audioStream) {
+            packet_queue_put(&audioq, pPacket);
+        } else {
+            av_packet_unref(pPacket);
+        }
     }
+    // 放一个空包通知视频解码线程文件已读完
+    av_packet_unref(pPacket);
+    packet_queue_put(&videoq, pPacket);
+    media_pool_put_packet(&video_pool, &pPacket);
+    return 0;
 }
 
-int packet_queue_put(PacketQueue* q, AVPacket* packet) {
-    AVPacketList* avPacketList = av_malloc(sizeof(AVPacketList));
-    if (!avPacketList) {
+int video_decode_thread(void* arg) {
+    AVCodecContext* pCodecCtx = (AVCodecContext*)arg;
+    AVPacket* pPacket = media_pool_get_packet(&video_pool);
+    AVFrame* pFrame = media_pool_get_frame(&video_pool);
+    if (!pPacket || !pFrame) {
+        printf("Could not allocate video decode packet/frame\n");
+        media_pool_put_packet(&video_pool, &pPacket);
+        media_pool_put_frame(&video_pool, &pFrame);
+        atomic_store(&video_finished, 1);
         return -1;
     }
-    avPacketList->pkt = *packet;
-    avPacketList->next = NULL;
-
-    /** 1.
-     * PacketQueue q:
-        +-----------------------------+
-        | first_pkt: NULL            |
-        | last_pkt: NULL             |
-        | nb_packets: 0              |
-        | size: 0                   |
-        | mutex: (SDL_mutex*)        |
-        | cond: (SDL_cond*)          |
-        +-----------------------------+
-        first_pkt 和 last_pkt 都为 NULL，表示队列为空。
-     */
-    /** 2.
-     * PacketQueue q:
-    +-----------------------------+
-    | first_pkt: -->[packet1]    |
-    | last_pkt: -->[packet1]     |
-    | nb_packets: 1              |
-    | size: packet1.size        |
-    | mutex: (SDL_mutex*)        |
-    | cond: (SDL_cond*)          |
-    +-----------------------------+
-
-    链表结构:
-    [packet1]--> NULL
-     */
-    /** 3.
-     * PacketQueue q:
-    +-----------------------------+
-    | first_pkt: -->[packet1]    |
-    | last_pkt: -->[packet2]     |
-    | nb_packets: 2              |
-    | size: packet1.size + packet2.size |
-    | mutex: (SDL_mutex*)        |
-    | cond: (SDL_cond*)          |
-    +-----------------------------+
-
-    链表结构:
-    [packet1]-->[packet2]--> NULL
-     */
-    /** 4.
-     * PacketQueue q:
-    +-----------------------------+
-    | first_pkt: -->[packet1]    |
-    | last_pkt: -->[packet3]     |
-    | nb_packets: 3              |
-    | size: packet1.size + packet2.size + packet3.size |
-    | mutex: (SDL_mutex*)        |
-    | cond: (SDL_cond*)          |
-    +-----------------------------+
-
-    链表结构:
-    [packet1]-->[packet2]-->[packet3]--> NULL
-     */
-    SDL_LockMutex(q->mutex);
-    if (!q->last_pkt) {
-        q->first_pkt = avPacketList;
-    } else {
-        // 将之前设置的最后一个avpacketList (包括first_pkt)设置链接next
-        q->last_pkt->next = avPacketList;
+    while (!quit) {
+        if (packet_queue_get(&videoq, pPacket, 1) < 0) {
+            break;
+        }
+        int64_t start = av_gettime_relative();
+        // 空包表示demux结束, 送NULL把解码器里剩余的帧冲刷出来
+        int eof = pPacket->data == NULL;
+        int ret = avcodec_send_packet(pCodecCtx, eof ? NULL : pPacket);
+        av_packet_unref(pPacket);
+        if (ret < 0) {
+            printf("avcodec_send_packet error\n");
+            if (eof) {
+                break;
+            }
+            continue;
+        }
+        while (ret >= 0) {
+            // 从pPacket包中接收其中一个帧的数据放进pFrame中
+            ret = avcodec_receive_frame(pCodecCtx, pFrame);
+            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+                break;
+            } else if (ret < 0) {
+                puts("avcodec_receive_frame error");
+                break;
+            }
+            stage_stats_add(&video_decode_stats, 1, av_gettime_relative() - start);
+            // pictq 满时在这里阻塞, 不计入解码耗时
+            if (frame_queue_put(&pictq, pFrame) < 0) {
+                break;
+            }
+            start = av_gettime_relative();
+        }
+        if (eof) {
+            break;
+        }
     }
-    // 默认将当前的对象放到最后一个item中.
-    q->last_pkt = avPacketList;
-    q->nb_packets++;
-    q->size += avPacketList->pkt.size;
-    SDL_CondSignal(q->cond);
-    SDL_UnlockMutex(q->mutex);
-
+    media_pool_put_frame(&video_pool, &pFrame);
+    media_pool_put_packet(&video_pool, &pPacket);
+    atomic_store(&video_finished, 1);
     return 0;
 }
+
+
 void audio_callback(void* userdata, Uint8* stream, int len) {
-    AVCodecContext* aCodecCtx = (AVCodecContext*)userdata;
+    // 回调运行在SDL的实时音频线程里: 只从PCM环形缓冲区拷贝, 不解码也不阻塞.
+    // 数据不够时补静音, 由 pcm_ring_read 记录 underrun.
+    PcmRing* ring = (PcmRing*)userdata;
+    pcm_ring_read(ring, stream, len, 0);
+    // 记录已取走的字节数, 供音频时钟使用
+    atomic_store(&audio_clock.consumed_bytes, (long long)atomic_load(&ring->read_pos));
+    atomic_store(&audio_clock.callback_time, av_gettime_relative());
+}
 
-    int len1 = -1;
-    int audio_size = -1;
-    // 音频缓冲大小1.5倍的最大音频帧大小, 这让ffmpeg一个合适的缓冲区间
-    static uint8_t audio_buf[(MAX_AUDIO_FRAME_SIZE * 3) / 2];
-    static unsigned int audio_buf_index = 0;
-    static unsigned int audio_buf_size = 0;
-    // when ask for a len of frame:
-    while (len > 0) {
-        if (quit) {
-            return;
+// 空音频输出: 代替声卡按回调的节奏从 audio_ring 取数据后丢弃.
+// 实时模式每隔一个缓冲的时长调一次 audio_callback, 数据不够时和声卡一样补静音记 underrun;
+// fast 模式有数据就取, 只取已有的部分, 不算 underrun. 音频时钟都由 audio_callback 更新.
+int null_audio_thread(void* arg) {
+    SDL_AudioSpec* specs = (SDL_AudioSpec*)arg;
+    uint8_t* buf = av_malloc(specs->size);
+    if (!buf) {
+        printf("Could not allocate null audio buffer\n");
+        return -1;
+    }
+    int64_t period = av_rescale(specs->samples, AV_TIME_BASE, specs->freq);
+    int64_t next = av_gettime_relative();
+    while (!quit && !atomic_load(&audio_ring.abort_request)) {
+        if (fast) {
+            unsigned int fill = pcm_ring_fill(&audio_ring);
+            if (fill == 0) {
+                av_usleep(1000);
+                continue;
+            }
+            audio_callback(&audio_ring, buf, FFMIN(fill, specs->size));
+            continue;
         }
-        if (audio_buf_index >= audio_buf_size) {
-            audio_size = audio_decode_frame(aCodecCtx, audio_buf, sizeof(audio_buf));
-            if (audio_size < 0) {
-                audio_buf_size = 1024;
+        // 按绝对时间排下一次回调, 睡眠误差不会累积
+        next += period;
+        int64_t now = av_gettime_relative();
+        if (next > now) {
+            av_usleep(next - now);
+        }
+        audio_callback(&audio_ring, buf, specs->size);
+    }
+    av_free(buf);
+    return 0;
+}
 
-                memset(audio_buf, 0, audio_buf_size);
-                printf("audio_decode_frame() failed.\n");
-            } else {
-                audio_buf_size = audio_size;
+int64_t audio_clock_get(AudioClock* clock) {
+    int64_t start_pts = atomic_load(&clock->start_pts);
+    if (start_pts == AV_NOPTS_VALUE || clock->bytes_per_sec <= 0) {
+        return AV_NOPTS_VALUE;
+    }
+    int64_t consumed = atomic_load(&clock->consumed_bytes);
+    int64_t elapsed = av_gettime_relative() - atomic_load(&clock->callback_time);
+    int64_t hw_buf_duration = av_rescale(clock->hw_buf_size, AV_TIME_BASE, clock->bytes_per_sec);
+    // 回调之后声卡最多还能播放一个缓冲的时长, underrun时时钟不能继续往前走
+    if (elapsed > hw_buf_duration) {
+        elapsed = hw_buf_duration;
+    }
+    return start_pts
+        + av_rescale(consumed - clock->start_bytes, AV_TIME_BASE, clock->bytes_per_sec)
+        - hw_buf_duration + elapsed;
+}
+
+int audio_decode_thread(void* arg) {
+    AVCodecContext* aCodecCtx = (AVCodecContext*)arg;
+    // 音频缓冲大小1.5倍的最大音频帧大小, 这让ffmpeg一个合适的缓冲区间
+    static uint8_t audio_buf[(MAX_AUDIO_FRAME_SIZE * 3) / 2];
+    while (!quit) {
+        int audio_size = audio_decode_frame(aCodecCtx, audio_buf, sizeof(audio_buf));
+        if (audio_size < 0) {
+            if (quit) {
+                break;
             }
-            audio_buf_index = 0;
+            printf("audio_decode_frame error\n");
+            continue;
         }
-        len1 = audio_buf_size - audio_buf_index;
-        if (len1 > len) {
-            len1 = len;
+        // 缓冲区满时在这里等待回调消费, 提前解码的量由 AUDIO_RING_SIZE 决定
+        if (pcm_ring_write(&audio_ring, audio_buf, audio_size) < 0) {
+            break;
         }
-        memcpy(stream, (uint8_t*)audio_buf + audio_buf_index, len1);
-        len -= len1;
-        stream += len1;
-        audio_buf_index += len1;
     }
+    return 0;
 }
 
 int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_size) {
-    AVPacket* avPacket = av_packet_alloc();
-    static uint8_t* audio_pkt_data = NULL;
-    static int audio_pkt_size = 0;
-
-    static AVFrame* avFrame = NULL;
-    avFrame = av_frame_alloc();
+    // 每次调用从池里取一个帧, 重采样拷出数据后放回, 不再每次 av_frame_alloc
+    AVFrame* avFrame = media_pool_get_frame(&audio_pool);
     if (!avFrame) {
         printf("av_frame_alloc error\n");
         return -1;
     }
+    int data_size = audio_decode_packets(aCodecCtx, avFrame, audio_buf, buf_size);
+    media_pool_put_frame(&audio_pool, &avFrame);
+    return data_size;
+}
+
+static int audio_decode_packets(AVCodecContext* aCodecCtx, AVFrame* avFrame, uint8_t* audio_buf, int buf_size) {
+    // 正在解码的包跨调用保留, 直到整包送进解码器后才换下一个包
+    static AVPacket* avPacket = NULL;
+    static uint8_t* audio_pkt_data = NULL;
+    static int audio_pkt_size = 0;
 
     int len1 = 0;
     int data_size = 0;
 
     for (;;) {
         if (quit) {
+            media_pool_put_packet(&audio_pool, &avPacket);
             return -1;
         }
         while (audio_pkt_size > 0) {
@@ -402,23 +764,36 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
             // 第一次avcodec_send_packet还未收到got_frame, 进入continue
             // 第二次avcodec_receive_frame收到got_frame, 进入if
             if (got_frame) {
-                data_size = audio_resampling(aCodecCtx, avFrame, AV_SAMPLE_FMT_S16,
+                data_size = audio_resampling(avFrame, AV_SAMPLE_FMT_S16,
                                             aCodecCtx->channels,
                                             aCodecCtx->sample_rate, audio_buf
                 );
                 assert(data_size <= buf_size);
+                // 第一个带pts的帧确定音频时钟的起点, 之后的时间由播放的字节数推算
+                if (data_size > 0 && avFrame->best_effort_timestamp != AV_NOPTS_VALUE &&
+                    atomic_load(&audio_clock.start_pts) == AV_NOPTS_VALUE) {
+                    audio_clock.bytes_per_sec = audio_resampler.out_sample_rate * audio_resampler.out_nb_channels *
+                        av_get_bytes_per_sample(audio_resampler.out_sample_fmt);
+                    audio_clock.start_bytes = atomic_load(&audio_ring.write_pos);
+                    atomic_store(&audio_clock.start_pts,
+                        av_rescale_q(avFrame->best_effort_timestamp, aCodecCtx->pkt_timebase, AV_TIME_BASE_Q));
+                }
             }
             if (data_size <= 0) {
                 continue;
             }
             return data_size;
         }
-        if (avPacket->data) {
-            av_packet_unref(avPacket);
+        // 上一个包用完放回池里, 再取一个接收下一个包
+        media_pool_put_packet(&audio_pool, &avPacket);
+        avPacket = media_pool_get_packet(&audio_pool);
+        if (!avPacket) {
+            printf("av_packet_alloc error\n");
+            return -1;
         }
-
         int ret = packet_queue_get(&audioq, avPacket, 1);
         if (ret < 0) {
+            media_pool_put_packet(&audio_pool, &avPacket);
             return -1;
         }
         audio_pkt_data = avPacket->data;
@@ -428,168 +803,23 @@ int audio_decode_frame(AVCodecContext *aCodecCtx, uint8_t *audio_buf, int buf_si
 
 }
 
-static int packet_queue_get(PacketQueue* q, AVPacket* pkt, int block) {
-    int ret;
-    AVPacketList* avPacketList;
-
-    SDL_LockMutex(q->mutex);
-    for (;;) {
-        if (quit) {
-            ret = -1;
-            break;
-        }
-        avPacketList = q->first_pkt;
-        if (avPacketList) {
-            q->first_pkt = avPacketList->next;
-            if (!q->first_pkt) {
-                q->last_pkt = NULL;
-            }
-            q->nb_packets--;
-            q->size -= avPacketList->pkt.size;
-            *pkt = avPacketList->pkt;
-            av_free(avPacketList);
-
-            ret = 1;
-            break;
-        } else if (!block) {
-            ret = 0;
-            break;
-        } else {
-            SDL_CondWait(q->cond, q->mutex);
-        }
-    }
-    SDL_UnlockMutex(q->mutex);
-    return ret;
-}
-
 static int audio_resampling(
-    AVCodecContext* audio_decode_ctx, AVFrame* decoded_audio_frame,
+    AVFrame* decoded_audio_frame,
     enum AVSampleFormat out_sample_fmt, int out_channels, int out_sample_rate,
     uint8_t* out_buf
 ) {
     if (quit) {
         return -1;
     }
-    SwrContext* swr_ctx = NULL;
-    int ret = 0;
-    int64_t in_channel_layout = audio_decode_ctx->channel_layout;
-    int64_t out_channel_layout = AV_CH_LAYOUT_STEREO;
-    int out_nb_channels = 0;
-    int out_linesize = 0;
-    int in_nb_samples = 0;
-    int out_nb_samples = 0;
-    int max_out_nb_samples = 0;
-    uint8_t** resampled_data = NULL;
-    int resampled_data_size = 0;
-
-    swr_ctx = swr_alloc();
-    if (!swr_ctx) {
-        fprintf(stderr, "Could not allocate resampler context\n");
-        exit(1);
-    }
-    if (audio_decode_ctx->channels == av_get_channel_layout_nb_channels(audio_decode_ctx->channel_layout)) {
-        in_channel_layout = audio_decode_ctx->channel_layout;
-    } else {
-        in_channel_layout = av_get_default_channel_layout(audio_decode_ctx->channels);
-    }
-    if (in_channel_layout <= 0) {
-        fprintf(stderr, "Could not set input channel layout\n");
-        return -1;
-    }
-
-    if (out_channels == 1) {
-        out_channel_layout = AV_CH_LAYOUT_MONO;
-    } else if (out_channels == 2) {
-        out_channel_layout = AV_CH_LAYOUT_STEREO;
-    } else {
-        out_channel_layout = AV_CH_LAYOUT_SURROUND;
-    }
-
-    in_nb_samples = decoded_audio_frame->nb_samples;
-    if (in_nb_samples <= 0) {
-        printf("Could not get input samples\n");
-        return -1;
-    }
-    av_opt_set_int(swr_ctx, "in_channel_layout", in_channel_layout, 0);
-    av_opt_set_int(swr_ctx, "in_sample_rate", audio_decode_ctx->sample_rate, 0);
-    av_opt_set_sample_fmt(swr_ctx, "in_sample_fmt", audio_decode_ctx->sample_fmt, 0);
-    av_opt_set_int(swr_ctx, "out_channel_layout", out_channel_layout, 0);
-    av_opt_set_int(swr_ctx, "out_sample_rate", out_sample_rate, 0);
-    av_opt_set_sample_fmt(swr_ctx, "out_sample_fmt", out_sample_fmt, 0);
-    ret = swr_init(swr_ctx);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to initialize the resampling context\n");
-        return;
-    }
-    // 算出最大的输出样本数
-    // a * b / c
-    max_out_nb_samples = out_nb_samples = av_rescale_rnd(in_nb_samples, out_sample_rate, audio_decode_ctx->sample_rate, AV_ROUND_UP);
-    if (max_out_nb_samples <= 0) {
-        printf("max_out_nb_samples <= 0\n");
-        return -1;
-    }
-    // get number of output audio channels
-    out_nb_channels = av_get_channel_layout_nb_channels(out_channel_layout);
-    // Allocate a data pointers array, samples buffer for nb_samples
-    // samples, and fill data pointers and linesize accordingly.
-    ret = av_samples_alloc_array_and_samples(&resampled_data, &out_linesize,
-                                            out_nb_channels, out_nb_samples,
-                                            out_sample_fmt, 0);
-    if (ret < 0) {
-        fprintf(stderr, "Could not allocate resampler data: %s\n",
-                av_err2str(ret));
-        return -1;
-    }
-    out_nb_samples = av_rescale_rnd(
-        swr_get_delay(swr_ctx, audio_decode_ctx->sample_rate)+in_nb_samples, out_sample_rate,
-        audio_decode_ctx->sample_rate,
-        AV_ROUND_UP
+    // SwrContext 和输出缓冲区由 audio_resampler 缓存, 只在输入格式变化时重建
+    uint8_t* resampled_data = NULL;
+    int resampled_data_size = audio_resampler_convert(
+        &audio_resampler, decoded_audio_frame,
+        out_sample_fmt, out_channels, out_sample_rate, &resampled_data
     );
-    if (out_nb_samples <= 0) {
-        fprintf(stderr, "Could not allocate out_nb_samples\n");
-        return -1;
-    }
-    if (out_nb_samples > max_out_nb_samples) {
-        av_free(resampled_data[0]);
-        ret = av_samples_alloc(
-            resampled_data, &out_linesize, out_nb_channels,
-            out_nb_samples, out_sample_fmt, 1
-        );
-        if (ret < 0) {
-            printf("av_samples_alloc fail\n");
-            return -1;
-        }
-        max_out_nb_samples = out_nb_channels;
-    }
-    if (swr_ctx) {
-        ret = swr_convert(
-            swr_ctx, resampled_data, out_nb_samples,
-            (const uint8_t **)decoded_audio_frame->data, decoded_audio_frame->nb_samples
-        );
-        if (ret < 0) {
-            printf("swr_convert fail\n");
-            return -1;
-        }
-        resampled_data_size = av_samples_get_buffer_size(
-            &out_linesize, out_nb_channels, ret, out_sample_fmt, 1
-        );
-        if (resampled_data_size < 0) {
-            printf("av_samples_get_buffer_size fail\n");
-            return -1;
-        }
-    } else {
-        printf("swr_ctx null error!\n");
+    if (resampled_data_size < 0) {
         return -1;
     }
-    memcpy(out_buf, resampled_data[0], resampled_data_size);
-
-    if (resampled_data) {
-        av_freep(&resampled_data[0]);
-    }
-    av_freep(&resampled_data);
-    resampled_data = NULL;
-    if (swr_ctx) {
-        swr_free(&swr_ctx);
-    }
+    memcpy(out_buf, resampled_data, resampled_data_size);
     return resampled_data_size;
 }